@@ -0,0 +1,703 @@
+#include <LoopbackServer.h>
+#include <Netascii.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <random>
+
+namespace {
+
+enum OperationCode { RRQ = 1, WRQ, DATA, ACK, ERR, OACK };
+
+constexpr int m_maxRetries = 5;
+constexpr size_t m_maxPacket = 65535;
+
+uint16_t readShort(const char *data) {
+  return static_cast<uint16_t>((static_cast<uint8_t>(data[0]) << 8) |
+                               static_cast<uint8_t>(data[1]));
+}
+
+void writeShort(char *data, uint16_t value) {
+  data[0] = static_cast<char>(value >> 8);
+  data[1] = static_cast<char>(value & 0xff);
+}
+
+// Maps a 16-bit block number onto the absolute block closest to reference.
+uint64_t absoluteBlock(uint16_t block, uint64_t reference) {
+  const uint64_t candidate = (reference & ~0xffffull) | block;
+  if (candidate + 0x8000 < reference) return candidate + 0x10000;
+  if (candidate > reference + 0x8000 && candidate >= 0x10000) {
+    return candidate - 0x10000;
+  }
+  return candidate;
+}
+
+}  // namespace
+
+class LoopbackServer::Link {
+ public:
+  Link(const Impairment &impairment, uint32_t seed, const sockaddr_in &peer,
+       const std::atomic<bool> &stopping)
+      : m_impairment(impairment),
+        m_random(seed),
+        m_peer(peer),
+        m_stopping(stopping) {}
+  ~Link() {
+    if (m_fd != -1) ::close(m_fd);
+  }
+
+  bool open() {
+    m_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_fd == -1) return false;
+    sockaddr_in local;
+    std::memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return ::bind(m_fd, reinterpret_cast<sockaddr *>(&local),
+                  sizeof(local)) == 0;
+  }
+
+  void send(const char *data, size_t size) {
+    if (chance(m_impairment.loss)) return;
+    const int copies = chance(m_impairment.duplicate) ? 2 : 1;
+    const Clock::time_point now = Clock::now();
+    for (int i = 0; i < copies; ++i) {
+      Clock::duration wait = m_impairment.delay;
+      if (m_impairment.jitter.count() > 0) {
+        std::uniform_int_distribution<int64_t> jitter(
+            0, m_impairment.jitter.count());
+        wait += std::chrono::microseconds(jitter(m_random));
+      }
+      if (chance(m_impairment.reorder)) {
+        wait += m_impairment.delay + m_impairment.jitter +
+                std::chrono::milliseconds(2);
+      }
+      if (wait.count() == 0 && m_pending.empty()) {
+        transmit(data, size);
+      } else {
+        m_pending.push({now + wait, m_sequence++,
+                        std::vector<char>(data, data + size)});
+      }
+    }
+  }
+
+  // Waits until deadline for a datagram from the peer while releasing
+  // delayed sends. Returns its size, 0 on timeout and -1 when stopping.
+  int receive(char *buffer, size_t size, Clock::time_point deadline) {
+    while (!m_stopping.load(std::memory_order_relaxed)) {
+      Clock::time_point now = Clock::now();
+      releaseDue(now);
+      if (now >= deadline) return 0;
+      Clock::time_point until =
+          std::min(deadline, now + std::chrono::milliseconds(50));
+      if (!m_pending.empty()) until = std::min(until, m_pending.top().due);
+      const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          until - now);
+      struct timespec timeout;
+      timeout.tv_sec = static_cast<time_t>(wait.count() / 1000000000);
+      timeout.tv_nsec = static_cast<long>(wait.count() % 1000000000);
+      struct pollfd pfd = {m_fd, POLLIN, 0};
+      if (::ppoll(&pfd, 1, &timeout, nullptr) <= 0) continue;
+
+      sockaddr_in source;
+      socklen_t length = sizeof(source);
+      const ssize_t received =
+          ::recvfrom(m_fd, buffer, size, 0,
+                     reinterpret_cast<sockaddr *>(&source), &length);
+      if (received < 0) continue;
+      if (source.sin_port != m_peer.sin_port) continue;
+      if (chance(m_impairment.loss)) continue;
+      return static_cast<int>(received);
+    }
+    return -1;
+  }
+
+  // Sends whatever is still held back; used before a transfer ends.
+  void drain() {
+    while (!m_pending.empty() && !m_stopping.load(std::memory_order_relaxed)) {
+      std::this_thread::sleep_until(m_pending.top().due);
+      releaseDue(Clock::now());
+    }
+  }
+
+ private:
+  struct Pending {
+    Clock::time_point due;
+    uint64_t sequence;
+    std::vector<char> data;
+    bool operator>(const Pending &other) const {
+      return due != other.due ? due > other.due : sequence > other.sequence;
+    }
+  };
+
+  bool chance(double probability) {
+    return probability > 0 && m_uniform(m_random) < probability;
+  }
+
+  void transmit(const char *data, size_t size) {
+    ::sendto(m_fd, data, size, 0, reinterpret_cast<const sockaddr *>(&m_peer),
+             sizeof(m_peer));
+  }
+
+  void releaseDue(Clock::time_point now) {
+    while (!m_pending.empty() && m_pending.top().due <= now) {
+      const Pending &next = m_pending.top();
+      transmit(next.data.data(), next.data.size());
+      m_pending.pop();
+    }
+  }
+
+  const Impairment &m_impairment;
+  std::mt19937 m_random;
+  std::uniform_real_distribution<double> m_uniform{0.0, 1.0};
+  sockaddr_in m_peer;
+  const std::atomic<bool> &m_stopping;
+  int m_fd = -1;
+  uint64_t m_sequence = 0;
+  std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>>
+      m_pending;
+};
+
+// Clients of one multicast file; the first serve() thread runs it, later
+// requests only queue up in `joining` (guarded by m_mutex).
+struct LoopbackServer::MulticastTransfer {
+  std::string name;
+  std::string content;
+  uint16_t blockSize = 512;
+  uint16_t port = 0;
+  std::vector<sockaddr_in> joining;
+};
+
+LoopbackServer::LoopbackServer(const Impairment &impairment, uint32_t seed)
+    : m_impairment(impairment), m_seed(seed) {}
+
+LoopbackServer::~LoopbackServer() { stop(); }
+
+bool LoopbackServer::start() {
+  m_listen = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (m_listen == -1) return false;
+  sockaddr_in local;
+  std::memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(local);
+  if (::bind(m_listen, reinterpret_cast<sockaddr *>(&local), length) != 0 ||
+      ::getsockname(m_listen, reinterpret_cast<sockaddr *>(&local),
+                    &length) != 0) {
+    ::close(m_listen);
+    m_listen = -1;
+    return false;
+  }
+  m_port = ntohs(local.sin_port);
+  m_stopping = false;
+  m_listener = std::thread(&LoopbackServer::listen, this);
+  return true;
+}
+
+void LoopbackServer::stop() {
+  m_stopping = true;
+  if (m_listener.joinable()) m_listener.join();
+  for (std::thread &transfer : m_transfers) transfer.join();
+  m_transfers.clear();
+  if (m_listen != -1) ::close(m_listen);
+  m_listen = -1;
+}
+
+void LoopbackServer::setFile(const std::string &name, std::string content) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_files[name] = std::move(content);
+}
+
+std::string LoopbackServer::upload(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto found = m_uploads.find(name);
+  return found == m_uploads.end() ? std::string() : found->second;
+}
+
+std::vector<double> LoopbackServer::takeLatencies() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<double> latencies;
+  latencies.swap(m_latencies);
+  return latencies;
+}
+
+bool LoopbackServer::waitCompleted(uint64_t transfers,
+                                   std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_completion.wait_for(lock, timeout,
+                               [&] { return m_completed >= transfers; });
+}
+
+void LoopbackServer::addLatencies(const std::vector<double> &latencies) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_latencies.insert(m_latencies.end(), latencies.begin(), latencies.end());
+    ++m_completed;
+  }
+  m_completion.notify_all();
+}
+
+void LoopbackServer::listen() {
+  std::vector<char> buffer(m_maxPacket);
+  uint32_t requests = 0;
+  while (!m_stopping) {
+    struct pollfd pfd = {m_listen, POLLIN, 0};
+    if (::poll(&pfd, 1, 50) <= 0) continue;
+    sockaddr_in peer;
+    socklen_t length = sizeof(peer);
+    const ssize_t received =
+        ::recvfrom(m_listen, buffer.data(), buffer.size(), 0,
+                   reinterpret_cast<sockaddr *>(&peer), &length);
+    if (received < 4) continue;
+    m_transfers.emplace_back(
+        &LoopbackServer::serve, this,
+        std::vector<char>(buffer.begin(), buffer.begin() + received), peer,
+        m_seed + ++requests);
+  }
+}
+
+void LoopbackServer::serve(std::vector<char> request, sockaddr_in peer,
+                           uint32_t seed) {
+  Link link(m_impairment, seed, peer, m_stopping);
+  if (!link.open()) return;
+
+  const uint16_t code = readShort(request.data());
+  request.push_back('\0');
+  std::vector<std::string> fields;
+  for (size_t start = 2; start + 1 < request.size();) {
+    const size_t end = std::find(request.begin() + start, request.end(), '\0') -
+                       request.begin();
+    fields.emplace_back(&request[start], end - start);
+    start = end + 1;
+  }
+  if ((code != RRQ && code != WRQ) || fields.size() < 2) return;
+
+  uint16_t blockSize = 512;
+  uint16_t windowSize = 1;
+  bool multicast = false;
+  bool transferSize = false;
+  std::chrono::milliseconds timeout(1000);
+  std::string oack;
+  oack += '\0';
+  oack += static_cast<char>(OACK);
+  for (size_t i = 2; i + 1 < fields.size(); i += 2) {
+    std::string name = fields[i];
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    const long value = std::atol(fields[i + 1].c_str());
+    if (name == "blksize" && value >= 8) {
+      blockSize = static_cast<uint16_t>(std::min(value, 65464l));
+    } else if (name == "windowsize" && value >= 1) {
+      windowSize = static_cast<uint16_t>(std::min(value, 65535l));
+    } else if (name == "timeout" && value >= 1) {
+      timeout = std::chrono::milliseconds(std::min(value, 255l) * 1000);
+    } else if (name == "multicast" && code == RRQ && !m_group.empty()) {
+      multicast = true;
+      continue;
+    } else if (name == "tsize" && code == RRQ) {
+      // Answered once the file is known.
+      transferSize = true;
+      continue;
+    } else {
+      continue;
+    }
+    oack += name;
+    oack += '\0';
+    oack += std::to_string(name == "blksize"      ? blockSize
+                           : name == "windowsize" ? windowSize
+                                                  : value);
+    oack += '\0';
+  }
+  bool options = oack.size() > 2;
+  const bool netascii = strcasecmp(fields[1].c_str(), "netascii") == 0;
+
+  if (code == RRQ) {
+    std::string content;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const auto found = m_files.find(fields[0]);
+      if (found == m_files.end()) {
+        const char error[] = "\0\5\0\1File not found";
+        link.send(error, sizeof(error));
+        link.drain();
+        return;
+      }
+      content = found->second;
+    }
+    if (multicast && !netascii) {
+      std::shared_ptr<MulticastTransfer> transfer;
+      {
+        // Join the running transfer of this file, or start one.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto &running = m_multicast[fields[0]];
+        if (running) {
+          running->joining.push_back(peer);
+          return;
+        }
+        running = std::make_shared<MulticastTransfer>();
+        running->name = fields[0];
+        running->content = std::move(content);
+        running->blockSize = blockSize;
+        running->port = static_cast<uint16_t>(m_port + 1 + m_groupPorts++ % 64);
+        running->joining.push_back(peer);
+        transfer = running;
+      }
+      serveMulticast(transfer, seed, timeout);
+      return;
+    }
+    if (transferSize && !netascii) {
+      oack += "tsize";
+      oack += '\0';
+      oack += std::to_string(content.size());
+      oack += '\0';
+      options = true;
+    }
+    if (netascii) {
+      std::string encoded(NetasciiEncoder<>::maxEncoded(content.size()), '\0');
+      encoded.resize(NetasciiEncoder<>::encode(content.data(), content.size(),
+                                               &encoded[0]));
+      content.swap(encoded);
+    }
+    if (options) {
+      // The OACK is answered with ACK 0 before any DATA goes out.
+      char packet[m_maxPacket];
+      bool acknowledged = false;
+      for (int retry = 0; retry <= m_maxRetries && !acknowledged; ++retry) {
+        link.send(oack.data(), oack.size());
+        const int size =
+            link.receive(packet, sizeof(packet), Clock::now() + timeout);
+        if (size < 0) return;
+        if (size >= 4 && readShort(packet) == ERR) return;
+        acknowledged = size >= 4 && readShort(packet) == ACK &&
+                       readShort(packet + 2) == 0;
+      }
+      if (!acknowledged) return;
+    }
+    sendFile(link, content, blockSize, windowSize, timeout);
+  } else {
+    if (options) {
+      link.send(oack.data(), oack.size());
+    } else {
+      const char ack[] = {0, ACK, 0, 0};
+      link.send(ack, sizeof(ack));
+    }
+    receiveFile(link, fields[0], netascii, blockSize, windowSize, timeout);
+  }
+  link.drain();
+}
+
+void LoopbackServer::sendFile(Link &link, const std::string &content,
+                              uint16_t blockSize, uint16_t windowSize,
+                              std::chrono::milliseconds timeout) {
+  const uint64_t blocks = content.size() / blockSize + 1;
+  std::vector<Clock::time_point> firstSent(blocks + 1);
+  std::vector<double> latencies;
+  latencies.reserve(blocks);
+  std::vector<char> packet(4 + blockSize);
+  char answer[m_maxPacket];
+  uint64_t acked = 0;
+  uint64_t next = 1;
+  int retries = 0;
+  int duplicates = 0;
+  // Only progress and retransmissions move it; ignored packets don't.
+  Clock::time_point deadline = Clock::now() + timeout;
+
+  while (acked < blocks) {
+    const uint64_t last = std::min<uint64_t>(acked + windowSize, blocks);
+    for (; next <= last; ++next) {
+      const uint64_t offset = (next - 1) * blockSize;
+      const size_t payload =
+          std::min<uint64_t>(blockSize, content.size() - offset);
+      writeShort(&packet[0], DATA);
+      writeShort(&packet[2], static_cast<uint16_t>(next));
+      std::memcpy(&packet[4], content.data() + offset, payload);
+      if (firstSent[next] == Clock::time_point()) {
+        firstSent[next] = Clock::now();
+      }
+      link.send(packet.data(), 4 + payload);
+    }
+
+    const int size = link.receive(answer, sizeof(answer), deadline);
+    if (size < 0) return;
+    if (size == 0) {
+      if (++retries > m_maxRetries) return;
+      next = acked + 1;
+      deadline = Clock::now() + timeout;
+      continue;
+    }
+    if (size < 4) continue;
+    if (readShort(answer) == ERR) return;
+    if (readShort(answer) != ACK) continue;
+    const uint64_t block = absoluteBlock(readShort(answer + 2), acked);
+    if (block == acked && next > acked + 1) {
+      // The client re-ACKs on its timeout. Every second duplicate restarts
+      // the window: a single one may just be a copy, and answering those
+      // would double every block from then on (Sorcerer's Apprentice).
+      if (++duplicates % 2 == 0) next = acked + 1;
+      continue;
+    }
+    if (block <= acked || block >= next) continue;
+    retries = 0;
+    duplicates = 0;
+    const Clock::time_point now = Clock::now();
+    deadline = now + timeout;
+    for (uint64_t done = acked + 1; done <= block; ++done) {
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(now - firstSent[done])
+              .count());
+    }
+    acked = block;
+    // A partial ACK asks to go back and resend the rest of the window.
+    if (acked + 1 < next) next = acked + 1;
+  }
+  addLatencies(latencies);
+}
+
+void LoopbackServer::serveMulticast(std::shared_ptr<MulticastTransfer> transfer,
+                                    uint32_t seed,
+                                    std::chrono::milliseconds timeout) {
+  const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd == -1) return;
+  sockaddr_in local;
+  std::memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local));
+  // Group traffic leaves through lo and loops back to the clients.
+  ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &local.sin_addr,
+               sizeof(local.sin_addr));
+  sockaddr_in group = local;
+  ::inet_pton(AF_INET, m_group.c_str(), &group.sin_addr);
+  group.sin_port = htons(transfer->port);
+
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const auto lost = [&] {
+    return m_impairment.loss > 0 && uniform(random) < m_impairment.loss;
+  };
+  const auto sendTo = [&](const sockaddr_in &to, const char *data,
+                          size_t size) {
+    if (lost()) return;
+    ::sendto(fd, data, size, 0, reinterpret_cast<const sockaddr *>(&to),
+             sizeof(to));
+  };
+  const auto same = [](const sockaddr_in &a, const sockaddr_in &b) {
+    return a.sin_port == b.sin_port && a.sin_addr.s_addr == b.sin_addr.s_addr;
+  };
+  // "addr,port,mc"; a client already in the group only learns its role.
+  const auto sendOack = [&](const sockaddr_in &to, bool master,
+                            bool address) {
+    std::string oack;
+    oack += '\0';
+    oack += static_cast<char>(OACK);
+    oack += "multicast";
+    oack += '\0';
+    if (address) oack += m_group + "," + std::to_string(transfer->port);
+    else oack += ",";
+    oack += master ? ",1" : ",0";
+    oack += '\0';
+    oack += "blksize";
+    oack += '\0';
+    oack += std::to_string(transfer->blockSize);
+    oack += '\0';
+    sendTo(to, oack.data(), oack.size());
+  };
+
+  const std::string &content = transfer->content;
+  const uint16_t blockSize = transfer->blockSize;
+  const uint64_t blocks = content.size() / blockSize + 1;
+  std::vector<char> packet(4 + blockSize);
+  char answer[m_maxPacket];
+  std::deque<sockaddr_in> clients;
+  uint64_t lastSent = 0;
+  int retries = 0;
+  Clock::time_point deadline = Clock::now() + timeout;
+  const auto nextMaster = [&] {
+    clients.pop_front();
+    retries = 0;
+    deadline = Clock::now() + timeout;
+    if (!clients.empty()) sendOack(clients.front(), true, false);
+  };
+
+  while (!m_stopping) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (const sockaddr_in &peer : transfer->joining) {
+        if (std::any_of(clients.begin(), clients.end(),
+                        [&](const sockaddr_in &c) { return same(c, peer); })) {
+          // A repeated request: tell it its role again.
+          sendOack(peer, same(clients.front(), peer), true);
+          continue;
+        }
+        clients.push_back(peer);
+        sendOack(peer, clients.size() == 1, true);
+        if (clients.size() == 1) deadline = Clock::now() + timeout;
+      }
+      transfer->joining.clear();
+      if (clients.empty()) {
+        m_multicast.erase(transfer->name);
+        break;
+      }
+    }
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 5) <= 0) {
+      if (Clock::now() < deadline) continue;
+      // The master went quiet: remind it, then give up on it.
+      if (++retries > m_maxRetries) {
+        nextMaster();
+      } else {
+        sendOack(clients.front(), true, true);
+        deadline = Clock::now() + timeout;
+      }
+      continue;
+    }
+    sockaddr_in source;
+    socklen_t length = sizeof(source);
+    const ssize_t size =
+        ::recvfrom(fd, answer, sizeof(answer), 0,
+                   reinterpret_cast<sockaddr *>(&source), &length);
+    if (size < 4 || lost()) continue;
+    const auto client =
+        std::find_if(clients.begin(), clients.end(),
+                     [&](const sockaddr_in &c) { return same(c, source); });
+    if (client == clients.end()) continue;
+    if (readShort(answer) == ERR) {
+      if (client == clients.begin()) {
+        nextMaster();
+      } else {
+        clients.erase(client);
+      }
+      continue;
+    }
+    // Only the master's ACKs drive the transfer.
+    if (readShort(answer) != ACK || client != clients.begin()) continue;
+    const uint64_t block = absoluteBlock(readShort(answer + 2), lastSent);
+    if (block >= blocks) {
+      addLatencies({});
+      nextMaster();
+      continue;
+    }
+    const uint64_t next = block + 1;
+    const uint64_t offset = (next - 1) * blockSize;
+    const size_t payload =
+        std::min<uint64_t>(blockSize, content.size() - offset);
+    writeShort(&packet[0], DATA);
+    writeShort(&packet[2], static_cast<uint16_t>(next));
+    std::memcpy(&packet[4], content.data() + offset, payload);
+    sendTo(group, packet.data(), 4 + payload);
+    lastSent = next;
+    retries = 0;
+    deadline = Clock::now() + timeout;
+  }
+  ::close(fd);
+}
+
+void LoopbackServer::receiveFile(Link &link, const std::string &name,
+                                 bool netascii, uint16_t blockSize,
+                                 uint16_t windowSize,
+                                 std::chrono::milliseconds timeout) {
+  std::string content;
+  std::vector<double> latencies;
+  // When the ACK that made room for a block went out.
+  std::map<uint64_t, Clock::time_point> opened;
+  const auto openWindow = [&](uint64_t ackedBlock) {
+    const Clock::time_point now = Clock::now();
+    for (uint64_t block = ackedBlock + 1; block <= ackedBlock + windowSize;
+         ++block) {
+      opened.emplace(block, now);
+    }
+  };
+  openWindow(0);
+
+  char packet[m_maxPacket];
+  char ack[4] = {0, ACK, 0, 0};
+  uint64_t expected = 1;
+  uint16_t sinceAck = 0;
+  bool restartRequested = false;
+  int retries = 0;
+  // Only progress and retransmissions move it; ignored packets don't.
+  Clock::time_point deadline = Clock::now() + timeout;
+  while (true) {
+    const int size = link.receive(packet, sizeof(packet), deadline);
+    if (size < 0) return;
+    if (size == 0) {
+      if (++retries > m_maxRetries) return;
+      writeShort(ack + 2, static_cast<uint16_t>(expected - 1));
+      link.send(ack, sizeof(ack));
+      deadline = Clock::now() + timeout;
+      continue;
+    }
+    if (size < 4 || readShort(packet) != DATA) {
+      if (size >= 4 && readShort(packet) == ERR) return;
+      continue;
+    }
+    const uint64_t block = absoluteBlock(readShort(packet + 2), expected);
+    // A block already received means our ACK was lost, so it is answered
+    // every time. A gap ahead asks for a restart once (RFC 7440).
+    if (block < expected || (block > expected && !restartRequested)) {
+      if (block > expected) restartRequested = true;
+      sinceAck = 0;
+      writeShort(ack + 2, static_cast<uint16_t>(expected - 1));
+      link.send(ack, sizeof(ack));
+      openWindow(expected - 1);
+    }
+    if (block != expected) continue;
+    restartRequested = false;
+    retries = 0;
+    deadline = Clock::now() + timeout;
+    const size_t payload = static_cast<size_t>(size) - 4;
+    content.append(packet + 4, payload);
+    const auto start = opened.find(block);
+    if (start != opened.end()) {
+      latencies.push_back(std::chrono::duration<double, std::micro>(
+                              Clock::now() - start->second)
+                              .count());
+      opened.erase(opened.begin(), std::next(start));
+    }
+    ++expected;
+    const bool last = payload < blockSize;
+    if (last) {
+      if (netascii) {
+        NetasciiDecoder<> decoder;
+        std::string decoded(decoder.maxDecoded(content.size()), '\0');
+        size_t size = decoder.decode(content.data(), content.size(),
+                                     &decoded[0]);
+        size += decoder.finish(&decoded[size]);
+        decoded.resize(size);
+        content.swap(decoded);
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_uploads[name] = std::move(content);
+      }
+      addLatencies(latencies);
+    }
+    if (++sinceAck >= windowSize || last) {
+      sinceAck = 0;
+      writeShort(ack + 2, static_cast<uint16_t>(block));
+      link.send(ack, sizeof(ack));
+      openWindow(block);
+    }
+    if (last) break;
+  }
+
+  // Dally: answer a retransmitted final block in case our ACK got lost.
+  const Clock::time_point until = Clock::now() + timeout;
+  while (true) {
+    const int size = link.receive(packet, sizeof(packet), until);
+    if (size <= 0) break;
+    if (size >= 4 && readShort(packet) == DATA) link.send(ack, sizeof(ack));
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef __LoopbackServer_H__
+#define __LoopbackServer_H__
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Network impairment applied by the server to every datagram it sends and
+// receives. Delay and jitter only apply to sends.
+struct Impairment {
+  double loss = 0;
+  double duplicate = 0;
+  // Probability a sent datagram is held back behind the ones that follow.
+  double reorder = 0;
+  std::chrono::microseconds delay{0};
+  std::chrono::microseconds jitter{0};
+};
+
+// Minimal TFTP server on 127.0.0.1 for benchmarking the client: serves RRQs
+// from in-memory files, keeps WRQ uploads in memory, understands blksize,
+// windowsize and timeout and answers each request from its own thread and
+// port like a real server. Netascii transfers are translated, the stored
+// files hold local text. With setMulticast() octet RRQs carrying the RFC
+// 2090 multicast option share one lock-step transfer per file.
+class LoopbackServer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit LoopbackServer(const Impairment &impairment, uint32_t seed = 1);
+  ~LoopbackServer();
+  LoopbackServer(const LoopbackServer &) = delete;
+  LoopbackServer &operator=(const LoopbackServer &) = delete;
+
+  bool start();
+  void stop();
+  uint16_t port() const { return m_port; }
+
+  void setFile(const std::string &name, std::string content);
+  // Multicast group (IPv4) for RFC 2090 transfers, sent over loopback.
+  void setMulticast(const std::string &group) { m_group = group; }
+  std::string upload(const std::string &name) const;
+  // Microseconds from the moment a block could be sent (get: its first
+  // transmission, put: the ACK opening its window) until it was
+  // acknowledged or received in order. Cleared by the call.
+  std::vector<double> takeLatencies();
+  // Waits until the server side of `transfers` transfers has finished in
+  // total, the client may return before the server saw the last packet.
+  bool waitCompleted(uint64_t transfers, std::chrono::milliseconds timeout);
+
+ private:
+  class Link;
+  struct MulticastTransfer;
+
+  void listen();
+  void serve(std::vector<char> request, sockaddr_in peer, uint32_t seed);
+  void sendFile(Link &link, const std::string &content, uint16_t blockSize,
+                uint16_t windowSize, std::chrono::milliseconds timeout);
+  void receiveFile(Link &link, const std::string &name, bool netascii,
+                   uint16_t blockSize, uint16_t windowSize,
+                   std::chrono::milliseconds timeout);
+  void serveMulticast(std::shared_ptr<MulticastTransfer> transfer,
+                      uint32_t seed, std::chrono::milliseconds timeout);
+  void addLatencies(const std::vector<double> &latencies);
+
+  Impairment m_impairment;
+  uint32_t m_seed;
+  int m_listen = -1;
+  uint16_t m_port = 0;
+  std::atomic<bool> m_stopping{false};
+  std::thread m_listener;
+  std::vector<std::thread> m_transfers;
+
+  mutable std::mutex m_mutex;
+  std::map<std::string, std::string> m_files;
+  std::map<std::string, std::string> m_uploads;
+  std::string m_group;
+  uint16_t m_groupPorts = 0;
+  std::map<std::string, std::shared_ptr<MulticastTransfer>> m_multicast;
+  std::vector<double> m_latencies;
+  uint64_t m_completed = 0;
+  std::condition_variable m_completion;
+};
+
+#endif
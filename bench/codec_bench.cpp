@@ -0,0 +1,135 @@
+#include <Packet.h>
+
+#include <getopt.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std;
+
+// Encodes and decodes each packet type in a loop and prints one JSON
+// object per type on stdout: time per round trip and the heap allocations
+// made inside the loop, which must be none. Exits non-zero otherwise.
+
+namespace {
+
+size_t allocations = 0;
+
+}  // namespace
+
+void *operator new(size_t size) {
+  ++allocations;
+  if (void *memory = malloc(size == 0 ? 1 : size)) return memory;
+  throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+static struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"iterations", required_argument, nullptr, 'i'},
+    {"blksize", required_argument, nullptr, 'b'},
+    {nullptr, 0, nullptr, 0}};
+
+const string usage(
+    "Usage:   codec_bench [--iterations n] [--blksize n]\n");
+
+// Folded into the output so the loops can't be optimised away.
+uint64_t checksum = 0;
+
+template <typename Round>
+bool run(const char *name, long iterations, Round round) {
+  const size_t before = allocations;
+  const auto start = chrono::steady_clock::now();
+  for (long i = 0; i < iterations; ++i) checksum += round(i);
+  const double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  const size_t made = allocations - before;
+  printf("{\"packet\":\"%s\",\"iterations\":%ld,\"ns_per_op\":%.2f,"
+         "\"allocations\":%zu}\n",
+         name, iterations, seconds * 1e9 / iterations, made);
+  return made == 0;
+}
+
+int main(int argc, char **argv) {
+  long iterations = 10000000;
+  size_t blockSize = 1468;
+  int index = 0;
+  int c = 0;
+  while (EOF !=
+         (c = getopt_long(argc, argv, "hi:b:", long_options, &index))) {
+    switch (c) {
+      case 'i':
+        iterations = max(1L, atol(optarg));
+        break;
+      case 'b':
+        blockSize = static_cast<size_t>(max(8, min(65464, atoi(optarg))));
+        break;
+      default:
+        cerr << usage;
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  static char payload[65464];
+  static char packet[Packet::m_headerSize + sizeof(payload)];
+  const Packet::Option options[] = {
+      {"blksize", "1468"}, {"windowsize", "64"}, {"timeout", "1"}};
+  bool clean = true;
+
+  clean &= run("data", iterations, [&](long i) {
+    const uint16_t block = static_cast<uint16_t>(i);
+    const size_t size =
+        Packet::data(packet, block, span<const char>(payload, blockSize));
+    PacketView view;
+    if (view.parse({packet, size}) != PacketView::Valid) return uint64_t(0);
+    return uint64_t(view.block()) + view.payload().size();
+  });
+  clean &= run("ack", iterations, [&](long i) {
+    const size_t size = Packet::ack(packet, static_cast<uint16_t>(i));
+    PacketView view;
+    if (view.parse({packet, size}) != PacketView::Valid) return uint64_t(0);
+    return uint64_t(view.block());
+  });
+  clean &= run("request", iterations, [&](long) {
+    const size_t size =
+        Packet::request(packet, Packet::RRQ, "images/firmware.bin", "octet",
+                        options);
+    PacketView view;
+    if (view.parse({packet, size}) != PacketView::Valid) return uint64_t(0);
+    uint64_t value = 0;
+    string_view text;
+    if (view.options().find("windowsize", text)) {
+      Packet::parseNumber(text, value);
+    }
+    return view.file().size() + value;
+  });
+  clean &= run("oack", iterations, [&](long) {
+    const size_t size = Packet::optionAck(packet, options);
+    PacketView view;
+    if (view.parse({packet, size}) != PacketView::Valid) return uint64_t(0);
+    uint64_t sum = 0;
+    for (const Packet::Option &option : view.options()) {
+      uint64_t value = 0;
+      if (Packet::parseNumber(option.value, value)) sum += value;
+    }
+    return sum;
+  });
+  clean &= run("error", iterations, [&](long i) {
+    const size_t size = Packet::error(packet, static_cast<uint16_t>(i & 7),
+                                      "Disk full or allocation exceeded");
+    PacketView view;
+    if (view.parse({packet, size}) != PacketView::Valid) return uint64_t(0);
+    return uint64_t(view.errorCode()) + view.errorMessage().size();
+  });
+
+  fprintf(stderr, "checksum %llu\n",
+          static_cast<unsigned long long>(checksum));
+  return clean ? 0 : 1;
+}
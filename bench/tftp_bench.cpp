@@ -0,0 +1,357 @@
+#include <LoopbackServer.h>
+#include <TFTPClient.h>
+
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Runs get/put against an in-process LoopbackServer over every combination
+// of file size and mode and prints one JSON object per run on stdout.
+
+static struct option long_options[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"sizes", required_argument, nullptr, 's'},
+    {"modes", required_argument, nullptr, 'm'},
+    {"repeat", required_argument, nullptr, 'r'},
+    {"blksize", required_argument, nullptr, 'b'},
+    {"windowsize", required_argument, nullptr, 'w'},
+    {"loss", required_argument, nullptr, 'l'},
+    {"delay", required_argument, nullptr, 'd'},
+    {"jitter", required_argument, nullptr, 'j'},
+    {"reorder", required_argument, nullptr, 'o'},
+    {"duplicate", required_argument, nullptr, 'u'},
+    {"seed", required_argument, nullptr, 'e'},
+    {"rate", required_argument, nullptr, 't'},
+    {"multicast", required_argument, nullptr, 'c'},
+    {"digest", required_argument, nullptr, 'g'},
+    {"zeros", required_argument, nullptr, 'z'},
+    {nullptr, 0, nullptr, 0}};
+
+const string usage(
+    "Usage:   tftp_bench [--sizes 64K,1M,16M] [--modes octet,netascii] "
+    "[--repeat n]\n"
+    "                    [--blksize n] [--windowsize n] [--loss p] "
+    "[--delay ms]\n"
+    "                    [--jitter ms] [--reorder p] [--duplicate p] "
+    "[--seed n]\n"
+    "                    [--rate mbps] [--multicast clients] "
+    "[--digest crc32c|sha256]\n"
+    "                    [--zeros fraction]\n");
+
+// With --multicast, `clients` clients fetch each file at once through one
+// RFC 2090 transfer (octet only) instead of the get/put runs.
+const char *const multicast_group = "239.255.69.69";
+
+vector<string> split_list(const string &list) {
+  vector<string> items;
+  stringstream stream(list);
+  string item;
+  while (getline(stream, item, ','))
+    if (!item.empty()) items.push_back(item);
+  return items;
+}
+
+uint64_t parse_size(const string &text) {
+  char *end = nullptr;
+  uint64_t size = strtoull(text.c_str(), &end, 10);
+  switch (*end) {
+    case 'G':
+    case 'g':
+      size <<= 10;
+      [[fallthrough]];
+    case 'M':
+    case 'm':
+      size <<= 10;
+      [[fallthrough]];
+    case 'K':
+    case 'k':
+      size <<= 10;
+    default:
+      break;
+  }
+  return size;
+}
+
+chrono::microseconds parse_ms(const char *text) {
+  return chrono::microseconds(static_cast<int64_t>(atof(text) * 1000));
+}
+
+// With `zeros`, that fraction of binary content is zeroed in 1 MB runs, the
+// way unused space looks in a disk image.
+string make_content(uint64_t size, bool text, mt19937 &random,
+                    double zeros = 0) {
+  string content(size, '\0');
+  uniform_int_distribution<int> byte(0, 255);
+  uniform_int_distribution<int> letter('a', 'z');
+  uniform_real_distribution<double> chance(0, 1);
+  const uint64_t run = 1 << 20;
+  for (uint64_t i = 0; i < size; ++i) {
+    if (text) {
+      content[i] = i % 64 == 63 ? '\n' : static_cast<char>(letter(random));
+    } else if (i % run == 0 && chance(random) < zeros) {
+      i += min(run, size - i) - 1;
+    } else {
+      content[i] = static_cast<char>(byte(random));
+    }
+  }
+  return content;
+}
+
+string read_file(const string &path) {
+  ifstream file(path.c_str(), ios::binary);
+  return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+double cpu_seconds(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+double percentile(vector<double> &values, double fraction) {
+  if (values.empty()) return 0;
+  const size_t rank = min(values.size() - 1,
+                          static_cast<size_t>(fraction * values.size()));
+  nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
+int main(int argc, char *argv[]) {
+  vector<string> sizes = {"64K", "1M", "16M"};
+  vector<string> modes = {"octet"};
+  int repeat = 3;
+  TransferOptions options;
+  Impairment impairment;
+  uint32_t seed = 1;
+  int clients = 0;
+  double zeros = 0;
+
+  int index = 0;
+  int c = 0;
+  while (EOF != (c = getopt_long(argc, argv, "hs:m:r:b:w:l:d:j:o:u:e:t:c:g:z:",
+                                 long_options, &index))) {
+    switch (c) {
+      case 's':
+        sizes = split_list(optarg);
+        break;
+      case 'm':
+        modes = split_list(optarg);
+        break;
+      case 'r':
+        repeat = max(1, atoi(optarg));
+        break;
+      case 'b':
+        options.blockSize = static_cast<uint16_t>(
+            clamp(atoi(optarg),
+                  static_cast<int>(TransferSession::m_minBlockSize),
+                  static_cast<int>(TransferSession::m_maxBlockSize)));
+        break;
+      case 'w':
+        options.windowSize =
+            static_cast<uint16_t>(clamp(atoi(optarg), 1, 65535));
+        break;
+      case 'l':
+        impairment.loss = atof(optarg);
+        break;
+      case 'd':
+        impairment.delay = parse_ms(optarg);
+        break;
+      case 'j':
+        impairment.jitter = parse_ms(optarg);
+        break;
+      case 'o':
+        impairment.reorder = atof(optarg);
+        break;
+      case 'u':
+        impairment.duplicate = atof(optarg);
+        break;
+      case 'e':
+        seed = static_cast<uint32_t>(atoi(optarg));
+        break;
+      case 't':
+        options.rateLimit = static_cast<uint64_t>(atof(optarg) * 1e6);
+        break;
+      case 'c':
+        clients = max(0, atoi(optarg));
+        break;
+      case 'z':
+        zeros = clamp(atof(optarg), 0.0, 1.0);
+        break;
+      case 'g':
+        if (!Digest::parseAlgorithm(optarg, options.digest)) {
+          cerr << usage;
+          return 1;
+        }
+        break;
+      default:
+        cerr << usage;
+        return c == 'h' ? 0 : 1;
+    }
+  }
+
+  // TFTPClient reads and writes in the working directory and logs to logs/.
+  char directory[] = "/tmp/tftp_bench.XXXXXX";
+  if (mkdtemp(directory) == nullptr || chdir(directory) != 0) {
+    perror("tftp_bench");
+    return 1;
+  }
+  mkdir("logs", 0755);
+
+  LoopbackServer server(impairment, seed);
+  if (!server.start()) {
+    perror("tftp_bench: loopback server");
+    return 1;
+  }
+  TFTPClient client("127.0.0.1", server.port(), "octet");
+  client.setVerbose(false);
+  mt19937 random(seed);
+  int failures = 0;
+  uint64_t completed = 0;
+
+  if (clients > 0) {
+    server.setMulticast(multicast_group);
+    options.mode = "octet";
+    for (const string &sizeText : sizes) {
+      const uint64_t size = parse_size(sizeText);
+      const string name = "bench-" + sizeText + "-multicast.bin";
+      const string content = make_content(size, false, random);
+      server.setFile(name, content);
+      for (int run = 0; run < repeat; ++run) {
+        vector<TFTPClient::status> results(clients);
+        vector<thread> threads;
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < clients; ++i) {
+          threads.emplace_back([&, i] {
+            TFTPClient receiver("127.0.0.1", server.port(), "octet");
+            receiver.setVerbose(false);
+            receiver.setOptions(options);
+            results[i] = receiver.getMulticast(name, name + "." +
+                                                         to_string(i));
+          });
+        }
+        for (thread &receiver : threads) receiver.join();
+        const double seconds = chrono::duration<double>(
+                                   chrono::steady_clock::now() - start)
+                                   .count();
+        int intact = 0;
+        for (int i = 0; i < clients; ++i) {
+          const string local = name + "." + to_string(i);
+          if (results[i] == TFTPClient::status::Success &&
+              read_file(local) == content) {
+            ++intact;
+          }
+          unlink(local.c_str());
+        }
+        if (intact != clients) ++failures;
+        server.takeLatencies();
+        printf(
+            "{\"direction\":\"mcget\",\"size\":%llu,\"run\":%d,"
+            "\"clients\":%d,\"ok\":%s,\"intact\":%d,\"blksize\":%u,"
+            "\"loss\":%g,\"seconds\":%.6f,\"throughput_mbps\":%.3f}\n",
+            static_cast<unsigned long long>(size), run, clients,
+            intact == clients ? "true" : "false", intact, options.blockSize,
+            impairment.loss, seconds,
+            seconds > 0 ? size * 8 / seconds / 1e6 : 0.0);
+        fflush(stdout);
+      }
+    }
+    sizes.clear();
+  }
+
+  for (const string &sizeText : sizes) {
+    const uint64_t size = parse_size(sizeText);
+    for (const string &mode : modes) {
+      const string name = "bench-" + sizeText + "-" + mode + ".bin";
+      const string content =
+          make_content(size, mode == "netascii", random, zeros);
+      options.mode = mode;
+      // Both directions verify against the digest of the local bytes.
+      if (options.digest != Digest::NoDigest) {
+        Digest digest(options.digest);
+        digest.update(content.data(), content.size());
+        options.expectedDigest = digest.value();
+      }
+      client.setOptions(options);
+      for (const bool isGet : {true, false}) {
+        for (int run = 0; run < repeat; ++run) {
+          if (isGet) {
+            server.setFile(name, content);
+            unlink(name.c_str());
+          } else {
+            ofstream(name.c_str(), ios::binary | ios::trunc) << content;
+          }
+          server.takeLatencies();
+
+          const double processStart = cpu_seconds(RUSAGE_SELF);
+          const double clientStart = cpu_seconds(RUSAGE_THREAD);
+          const auto start = chrono::steady_clock::now();
+          const TFTPClient::status result =
+              isGet ? client.get(name) : client.put(name);
+          const double seconds = chrono::duration<double>(
+                                     chrono::steady_clock::now() - start)
+                                     .count();
+          const double clientCpu = cpu_seconds(RUSAGE_THREAD) - clientStart;
+          const double processCpu = cpu_seconds(RUSAGE_SELF) - processStart;
+
+          if (result == TFTPClient::status::Success) {
+            server.waitCompleted(++completed, chrono::milliseconds(1000));
+          }
+          const bool intact =
+              result == TFTPClient::status::Success &&
+              (isGet ? read_file(name) : server.upload(name)) == content;
+          if (!intact) ++failures;
+          vector<double> latencies = server.takeLatencies();
+          const TransferStats &stats = client.lastStats();
+          const double gigabytes = size / 1e9;
+          printf(
+              "{\"direction\":\"%s\",\"mode\":\"%s\",\"size\":%llu,"
+              "\"run\":%d,\"ok\":%s,\"result\":%d,\"blksize\":%u,"
+              "\"windowsize\":%u,\"loss\":%g,\"delay_ms\":%g,"
+              "\"jitter_ms\":%g,\"reorder\":%g,\"duplicate\":%g,"
+              "\"seconds\":%.6f,\"throughput_mbps\":%.3f,"
+              "\"block_latency_p50_us\":%.1f,\"block_latency_p99_us\":%.1f,"
+              "\"cpu_s_per_gb\":%.4f,\"client_cpu_s_per_gb\":%.4f,"
+              "\"retransmits\":%llu,\"timeouts\":%llu,\"sparse_bytes\":%llu}\n",
+              isGet ? "get" : "put", mode.c_str(),
+              static_cast<unsigned long long>(size), run,
+              intact ? "true" : "false", static_cast<int>(result),
+              options.blockSize, options.windowSize, impairment.loss,
+              impairment.delay.count() / 1000.0,
+              impairment.jitter.count() / 1000.0, impairment.reorder,
+              impairment.duplicate, seconds,
+              seconds > 0 ? size * 8 / seconds / 1e6 : 0.0,
+              percentile(latencies, 0.5), percentile(latencies, 0.99),
+              gigabytes > 0 ? processCpu / gigabytes : 0.0,
+              gigabytes > 0 ? clientCpu / gigabytes : 0.0,
+              static_cast<unsigned long long>(stats.retransmits),
+              static_cast<unsigned long long>(stats.timeouts),
+              static_cast<unsigned long long>(stats.sparseBytes));
+          fflush(stdout);
+        }
+      }
+      unlink(name.c_str());
+    }
+  }
+
+  server.stop();
+  error_code error;
+  filesystem::remove_all(directory, error);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#ifndef __AsyncClient_H__
+#define __AsyncClient_H__
+
+#include <TransferEngine.h>
+#include <TransferSession.h>
+#include <TransferStats.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Non-blocking client for embedding: transfers run on a private
+// TransferEngine thread, calls return a handle at once and completion is
+// reported through a callback (run on the engine thread) or a future.
+// Nothing is printed or logged; sockets come from an injectable factory.
+class AsyncClient {
+ public:
+  using Handle = uint64_t;
+  using Callback = std::function<void(Handle, const TransferResult &)>;
+
+  AsyncClient(const std::string &ip, uint16_t port,
+              const TransferOptions &options = TransferOptions(),
+              TransferEngine::SocketFactory socketFactory =
+                  TransferEngine::SocketFactory());
+  // Cancels whatever is still running; callbacks still fire.
+  ~AsyncClient();
+  AsyncClient(const AsyncClient &) = delete;
+  AsyncClient &operator=(const AsyncClient &) = delete;
+
+  Handle start(TransferSession::Direction direction,
+               const std::string &remoteFile, const std::string &localFile,
+               const TransferOptions &options, Callback done);
+  Handle get(const std::string &remoteFile, const std::string &localFile,
+             Callback done) {
+    return start(TransferSession::Get, remoteFile, localFile, m_options,
+                 std::move(done));
+  }
+  Handle put(const std::string &localFile, const std::string &remoteFile,
+             Callback done) {
+    return start(TransferSession::Put, remoteFile, localFile, m_options,
+                 std::move(done));
+  }
+  std::future<TransferResult> get(const std::string &remoteFile,
+                                  const std::string &localFile);
+  std::future<TransferResult> put(const std::string &localFile,
+                                  const std::string &remoteFile);
+
+  void cancel(Handle handle);
+
+ private:
+  std::future<TransferResult> startFuture(TransferSession::Direction direction,
+                                          const std::string &remoteFile,
+                                          const std::string &localFile);
+  void run();
+
+  std::string m_remoteAddress;
+  uint16_t m_port;
+  TransferOptions m_options;
+  TransferEngine m_engine;
+  std::atomic<Handle> m_nextHandle{1};
+  // Engine thread only.
+  std::unordered_map<Handle, TransferEngine::Id> m_running;
+  std::atomic<bool> m_stopping{false};
+  std::thread m_thread;
+};
+
+#endif
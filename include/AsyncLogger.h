@@ -0,0 +1,76 @@
+#ifndef __AsyncLogger_H__
+#define __AsyncLogger_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Log file fed through a bounded lock-free ring. log() only stamps the
+// message and copies it into a slot; a background thread formats the time,
+// writes and flushes, and sleeps while the ring is empty. When the ring is
+// full messages are dropped and counted rather than blocking the caller;
+// messages longer than a slot are cut and end with m_truncated.
+class AsyncLogger {
+ public:
+  static constexpr size_t m_slots = 1024;
+  static constexpr size_t m_messageSize = 240;
+  static constexpr const char *m_truncated = "...(truncated)";
+
+  AsyncLogger();
+  ~AsyncLogger();
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+  bool open(const std::string &path);
+  void close();
+  bool isOpen() const { return m_file != nullptr; }
+
+  bool log(const char *message, size_t size);
+  bool log(const std::string &message) {
+    return log(message.data(), message.size());
+  }
+  uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+ private:
+  using Clock = std::chrono::system_clock;
+
+  struct Record {
+    Clock::time_point time;
+    uint16_t length;
+    char text[m_messageSize];
+  };
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Record record;
+  };
+
+  void run();
+  void wake();
+  bool pending() const {
+    return m_ring[m_dequeue % m_slots].sequence.load(
+               std::memory_order_acquire) == m_dequeue + 1;
+  }
+  void write(const Record &record);
+
+  std::unique_ptr<Slot[]> m_ring;
+  alignas(64) std::atomic<size_t> m_enqueue{0};
+  alignas(64) size_t m_dequeue = 0;
+  std::atomic<uint64_t> m_dropped{0};
+  uint64_t m_reportedDrops = 0;
+  std::atomic<bool> m_stopping{false};
+  // Set by the drain thread before it sleeps; the first log() to see it
+  // clears it and wakes the thread.
+  alignas(64) std::atomic<bool> m_sleeping{false};
+  std::thread m_thread;
+  std::FILE *m_file = nullptr;
+  // Cache of the formatted timestamp, it only changes once a second.
+  std::time_t m_stampTime = -1;
+  char m_stamp[32];
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __CoClient_H__
+#define __CoClient_H__
+
+#include <Executor.h>
+#include <TransferSession.h>
+
+#include <coroutine>
+#include <cstdint>
+#include <string>
+
+// Coroutine front end: `TransferResult r = co_await client.get(name);`.
+// Every transfer is a TransferSession on the executor's engine, so any
+// number of them interleave on one thread.
+class CoClient {
+ public:
+  class Transfer {
+   public:
+    Transfer(CoClient &client, TransferSession::Direction direction,
+             const std::string &remoteFile, const std::string &localFile)
+        : m_client(client),
+          m_direction(direction),
+          m_remoteFile(remoteFile),
+          m_localFile(localFile) {}
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> awaiting);
+    TransferResult await_resume() { return std::move(m_result); }
+
+   private:
+    CoClient &m_client;
+    TransferSession::Direction m_direction;
+    std::string m_remoteFile;
+    std::string m_localFile;
+    TransferResult m_result;
+  };
+
+  CoClient(Executor &executor, const std::string &ip, uint16_t port,
+           const TransferOptions &options = TransferOptions())
+      : m_executor(executor),
+        m_remoteAddress(ip),
+        m_port(port),
+        m_options(options) {}
+
+  void setOptions(const TransferOptions &options) { m_options = options; }
+  const TransferOptions &options() const { return m_options; }
+
+  Transfer get(const std::string &remoteFile) {
+    return get(remoteFile, remoteFile);
+  }
+  Transfer get(const std::string &remoteFile, const std::string &localFile) {
+    return Transfer(*this, TransferSession::Get, remoteFile, localFile);
+  }
+  Transfer put(const std::string &localFile) {
+    return put(localFile, localFile);
+  }
+  Transfer put(const std::string &localFile, const std::string &remoteFile) {
+    return Transfer(*this, TransferSession::Put, remoteFile, localFile);
+  }
+
+ private:
+  Executor &m_executor;
+  std::string m_remoteAddress;
+  uint16_t m_port;
+  TransferOptions m_options;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __CongestionControl_H__
+#define __CongestionControl_H__
+
+#include <chrono>
+#include <cstdint>
+
+// Slow start and AIMD for the sending side, in blocks per round trip.
+// Windowed TFTP receivers only ACK once a whole negotiated window has
+// arrived, so the window in flight can't shrink without stalling them;
+// instead the congestion window sets the pacing rate, cwnd blocks per path
+// RTT. Path RTT is the smallest per-block sample of the last m_rttWindow:
+// a window's ACK can wait on pacing, loss recovery or the receiver's own
+// timeout, none of which should slow the rate further, while a path that
+// got slower is picked up once its old minimum expires.
+class CongestionControl {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Duration = std::chrono::microseconds;
+
+  static constexpr double m_initialWindow = 4;
+  static constexpr double m_minWindow = 2;
+  static constexpr double m_maxWindow = 1 << 20;
+  static constexpr std::chrono::seconds m_rttWindow{10};
+
+  // `blocks` newly acknowledged at `now`; `rtt` is zero when no sample was
+  // taken (retransmitted block, Karn's rule).
+  void onAck(uint32_t blocks, Duration rtt, Clock::time_point now);
+  // Duplicate or partial ACK: halve, at most once per window of data.
+  // `acked` and `sent` are the highest acknowledged and sent blocks.
+  void onCongestion(uint32_t acked, uint32_t sent);
+  // Retransmission timeout: back to slow start.
+  void onTimeout(uint32_t sent);
+
+  double window() const { return m_window; }
+  bool slowStart() const { return m_window < m_threshold; }
+  Duration pathRtt() const { return m_rtt[0].rtt; }
+  // Bytes per second for packets of `packetSize`, 0 before the first RTT
+  // sample.
+  uint64_t rate(size_t packetSize) const;
+
+ private:
+  struct RttSample {
+    Clock::time_point time;
+    Duration rtt = Duration::zero();
+  };
+
+  void sampleRtt(Duration rtt, Clock::time_point now);
+
+  double m_window = m_initialWindow;
+  double m_threshold = m_maxWindow;
+  // Windowed minimum: the best sample, and the best ones taken after it
+  // in the later quarter and half of the window, which step up in turn
+  // as the earlier ones expire.
+  RttSample m_rtt[3];
+  // No further decrease until everything sent at the last one is acked.
+  uint32_t m_recover = 0;
+  bool m_recovering = false;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __DataStream_H__
+#define __DataStream_H__
+
+#include <cstddef>
+#include <ios>
+#include <string>
+
+// Where a get delivers its data and where a put takes it from when it is
+// not a local file: a pipe, stdin/stdout or memory. Data moves straight
+// between the socket and the stream, without a temporary file.
+class DataSink {
+ public:
+  virtual ~DataSink() {}
+  // False fails the transfer with WriteFileError.
+  virtual bool write(const char *data, size_t size) = 0;
+  // After the last block, before the final ACK is sent.
+  virtual bool finish() { return true; }
+};
+
+class DataSource {
+ public:
+  virtual ~DataSource() {}
+  // Fills `data` completely unless the data ends first; -1 on errors.
+  virtual std::streamsize read(char *data, size_t size) = 0;
+};
+
+// A descriptor the caller owns, e.g. STDOUT_FILENO or one end of a pipe.
+// A slow reader on the other end slows the transfer down with it.
+class FdSink : public DataSink {
+ public:
+  explicit FdSink(int fd) : m_fd(fd) {}
+  bool write(const char *data, size_t size) override;
+
+ private:
+  int m_fd;
+};
+
+class FdSource : public DataSource {
+ public:
+  explicit FdSource(int fd) : m_fd(fd) {}
+  std::streamsize read(char *data, size_t size) override;
+
+ private:
+  int m_fd;
+};
+
+class MemorySink : public DataSink {
+ public:
+  bool write(const char *data, size_t size) override {
+    m_data.append(data, size);
+    return true;
+  }
+  const std::string &data() const { return m_data; }
+  std::string take() { return std::move(m_data); }
+
+ private:
+  std::string m_data;
+};
+
+class MemorySource : public DataSource {
+ public:
+  explicit MemorySource(std::string data) : m_data(std::move(data)) {}
+  std::streamsize read(char *data, size_t size) override;
+
+ private:
+  std::string m_data;
+  size_t m_offset = 0;
+};
+
+#endif
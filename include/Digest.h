@@ -0,0 +1,74 @@
+#ifndef __Digest_H__
+#define __Digest_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental checksums, fed block by block on the transfer's data path so
+// verifying a download doesn't take a second pass over the file. The CPU
+// is checked once: Crc32c uses the SSE4.2 crc32 instruction and Sha256 the
+// SHA extensions when present, portable code otherwise.
+
+// CRC-32C (Castagnoli), as in iSCSI and ext4.
+class Crc32c {
+ public:
+  void update(const void *data, size_t size);
+  uint32_t value() const { return ~m_crc; }
+  void reset() { m_crc = ~0u; }
+
+ private:
+  uint32_t m_crc = ~0u;
+};
+
+// SHA-256 (FIPS 180-4).
+class Sha256 {
+ public:
+  using Hash = std::array<uint8_t, 32>;
+
+  Sha256() { reset(); }
+  void update(const void *data, size_t size);
+  // Pads and returns the hash; reset() before reusing.
+  Hash finish();
+  void reset();
+
+ private:
+  uint32_t m_state[8];
+  uint8_t m_buffer[64];
+  size_t m_buffered = 0;
+  uint64_t m_length = 0;
+};
+
+// One of the above picked at run time, written as "crc32c:<8 hex>" or
+// "sha256:<64 hex>".
+class Digest {
+ public:
+  enum Algorithm { NoDigest, Crc32cDigest, Sha256Digest };
+
+  explicit Digest(Algorithm algorithm = NoDigest) : m_algorithm(algorithm) {}
+
+  Algorithm algorithm() const { return m_algorithm; }
+  bool enabled() const { return m_algorithm != NoDigest; }
+  void update(const void *data, size_t size);
+  // "algorithm:hex"; finishes the digest.
+  std::string value();
+
+  static const char *name(Algorithm algorithm);
+  static bool parseAlgorithm(const std::string &name, Algorithm &algorithm);
+  // "sha256:<hex>", "crc32c:<hex>", or bare hex told apart by its length.
+  // Normalises `digest` to the lower-case "algorithm:hex" form.
+  static bool parse(const std::string &text, Algorithm &algorithm,
+                    std::string &digest);
+  // Looks `file` up in a sha256sum-style manifest ("<hex>  <name>" per
+  // line, names compared without their directories).
+  static bool fromManifest(const std::string &path, const std::string &file,
+                           Algorithm &algorithm, std::string &digest);
+
+ private:
+  Algorithm m_algorithm;
+  Crc32c m_crc;
+  Sha256 m_sha;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __DirectorySync_H__
+#define __DirectorySync_H__
+
+#include <Digest.h>
+#include <ProgressRenderer.h>
+#include <TransferPool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Mirrors the files a manifest names into a local directory, fetching only
+// the ones that changed. A state file in the directory keeps, per file, the
+// size and modification time it was written with and the digest of its
+// bytes. A file whose record still holds is probed with a request that asks
+// for its size (RFC 2349 tsize) and is turned down at the OACK; it is only
+// fetched again when that size or the manifest's digest differ from the
+// record. Probes and downloads run on a pool of `jobs` workers.
+class DirectorySync {
+ public:
+  enum status { Success, ManifestError, DirectoryError, TransferFailed };
+
+  struct Summary {
+    size_t files = 0;
+    size_t unchanged = 0;
+    size_t transferred = 0;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+  };
+
+  static constexpr const char *m_stateName = ".l_tftp-sync";
+  // Downloads land here first and replace the file once complete.
+  static constexpr const char *m_partSuffix = ".part";
+
+  // `report` additionally sees every finished probe and download; `log`
+  // is passed on to the pool.
+  DirectorySync(const std::string &ip, uint16_t port, size_t jobs,
+                const TransferOptions &options,
+                ProgressRenderer::Output output = ProgressRenderer::Output(),
+                TransferPool::Report report = TransferPool::Report(),
+                std::shared_ptr<AsyncLogger> log = nullptr);
+
+  // The manifest lists one remote file per line, optionally after its
+  // digest as sha256sum writes it ("<hex>  <name>").
+  status run(const std::string &manifest, const std::string &directory);
+  const Summary &summary() const { return m_summary; }
+
+ private:
+  struct Entry {
+    std::string name;
+    // "algorithm:hex", empty when the manifest has none.
+    std::string digest;
+  };
+
+  struct Record {
+    uint64_t size = 0;
+    int64_t modified = 0;
+    std::string digest;
+  };
+
+  bool readManifest(const std::string &path);
+  void loadState();
+  bool saveState();
+  bool appendState(const std::string &name, const Record &record);
+  std::string localPath(const std::string &name) const {
+    return m_directory + "/" + name;
+  }
+  // Size and modification time (ns) of a regular file.
+  static bool stat(const std::string &path, Record &record);
+  static std::string hash(const std::string &path,
+                          Digest::Algorithm algorithm);
+  bool current(const Entry &entry);
+  void fetch(const Entry &entry);
+  void finished(const TransferPool::Task &task, TransferSession::status code,
+                const TransferStats &stats);
+  void print(const std::string &message) {
+    if (m_output) m_output(message);
+  }
+
+  TransferOptions m_options;
+  ProgressRenderer::Output m_output;
+  TransferPool::Report m_report;
+  std::string m_directory;
+  std::vector<Entry> m_entries;
+  std::map<std::string, Record> m_records;
+  // Guards the records, the journal, the sizes and the summary while the
+  // pool runs.
+  std::mutex m_mutex;
+  std::ofstream m_journal;
+  // Probe answers: whether the server gave a size, and which.
+  std::map<std::string, std::pair<bool, uint64_t>> m_sizes;
+  Summary m_summary;
+  TransferPool m_pool;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __Endpoint_H__
+#define __Endpoint_H__
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <string>
+
+// A resolved UDP address, IPv4 or IPv6. Resolving happens once per
+// transfer instead of once per packet.
+class Endpoint {
+ public:
+  Endpoint() {}
+
+  // Host names and numeric addresses of either family go through
+  // getaddrinfo; `family` AF_UNSPEC takes the first result.
+  bool resolve(const std::string &host, uint16_t port,
+               int family = AF_UNSPEC);
+  void assign(const sockaddr *address, socklen_t length);
+
+  bool valid() const { return m_length != 0; }
+  int family() const { return m_address.ss_family; }
+  uint16_t port() const;
+  void setPort(uint16_t port);
+  std::string host() const;
+
+  const sockaddr *address() const {
+    return reinterpret_cast<const sockaddr *>(&m_address);
+  }
+  socklen_t length() const { return m_length; }
+
+  bool operator==(const Endpoint &other) const;
+  bool operator!=(const Endpoint &other) const { return !(*this == other); }
+
+ private:
+  sockaddr_storage m_address{};
+  socklen_t m_length = 0;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __Executor_H__
+#define __Executor_H__
+
+#include <Task.h>
+#include <TransferEngine.h>
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <optional>
+
+// Single-threaded executor for transfer coroutines: a ready queue of
+// coroutine handles in front of a TransferEngine. Coroutines suspended on a
+// transfer are resumed from run() once the engine completes it.
+class Executor {
+ public:
+  Executor() {}
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  TransferEngine &engine() { return m_engine; }
+
+  void schedule(std::coroutine_handle<> coroutine) {
+    m_ready.push_back(coroutine);
+  }
+
+  // Starts a task that nobody awaits; it runs on the next run().
+  void spawn(Task<void> task);
+
+  // Runs until every spawned task has finished and no transfer is left.
+  void run();
+
+  // Runs a task to completion and returns its result.
+  template <typename T>
+  T run(Task<T> task) {
+    std::optional<T> result;
+    spawn(store(std::move(task), result));
+    run();
+    return std::move(*result);
+  }
+
+  size_t pending() const { return m_detached; }
+
+ private:
+  struct Detached {
+    struct promise_type {
+      Detached get_return_object() {
+        return {std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  static Detached detach(Executor &executor, Task<void> task);
+  template <typename T>
+  static Task<void> store(Task<T> task, std::optional<T> &result) {
+    result = co_await task;
+  }
+
+  TransferEngine m_engine;
+  std::deque<std::coroutine_handle<>> m_ready;
+  size_t m_detached = 0;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __FileCache_H__
+#define __FileCache_H__
+
+#include <MappedFile.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Read-only file mappings shared by every transfer of the same file, so a
+// file fetched by many clients at once is served from one preloaded
+// mapping. Lookups revalidate the entry against inode, size and mtime;
+// beyond the byte budget the least recently used entries are dropped,
+// while transfers still holding them keep them alive.
+//
+// Deliberately not thread-safe: each server worker owns its own cache and
+// the kernel shares the underlying pages between them.
+class FileCache {
+ public:
+  using Mapping = std::shared_ptr<const MappedFile>;
+
+  explicit FileCache(uint64_t capacity = uint64_t(1) << 30)
+      : m_capacity(capacity) {}
+
+  // Null when the file can't be mapped (missing, not a regular file).
+  Mapping get(const std::string &path);
+  void clear();
+
+  size_t entries() const { return m_entries.size(); }
+  uint64_t bytes() const { return m_bytes; }
+  uint64_t hits() const { return m_hits; }
+  uint64_t misses() const { return m_misses; }
+
+ private:
+  struct Entry {
+    Mapping mapping;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    std::list<std::string>::iterator recent;
+  };
+
+  void erase(std::unordered_map<std::string, Entry>::iterator entry);
+
+  uint64_t m_capacity;
+  uint64_t m_bytes = 0;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+  std::unordered_map<std::string, Entry> m_entries;
+  // Most recently used first.
+  std::list<std::string> m_recent;
+};
+
+#endif
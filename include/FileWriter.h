@@ -0,0 +1,77 @@
+#ifndef __FileWriter_H__
+#define __FileWriter_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Write-behind sink for a sequentially written file. write() copies into a
+// bounded ring of aligned chunks that a dedicated thread drains with
+// pwrite(), so the caller only waits when the whole ring is still queued.
+// Errors are sticky and reported by the next write() or by finish().
+class FileWriter {
+ public:
+  static constexpr size_t m_alignment = 4096;
+  static constexpr size_t m_defaultChunkSize = 256 * 1024;
+  static constexpr size_t m_defaultChunks = 8;
+
+  FileWriter(size_t chunkSize = m_defaultChunkSize,
+             size_t chunks = m_defaultChunks);
+  ~FileWriter();
+  FileWriter(const FileWriter &) = delete;
+  FileWriter &operator=(const FileWriter &) = delete;
+
+  // O_DIRECT falls back to buffered I/O where the file system refuses it.
+  bool open(const std::string &path, bool direct);
+  bool write(const char *data, size_t size);
+  // Moves past `size` bytes of zeros, leaving whole pages of them unwritten.
+  bool skip(size_t size);
+  // Writes out what is left and closes the file; false on any error.
+  bool finish();
+  // Abandons queued data and closes the file.
+  void close();
+
+  bool isOpen() const { return m_fd != -1; }
+  bool direct() const { return m_direct; }
+  int error() const;
+  // Time write() and finish() spent waiting for the writer thread.
+  std::chrono::microseconds stallTime() const { return m_stall; }
+
+ private:
+  struct Chunk {
+    char *data = nullptr;
+    size_t length = 0;
+    uint64_t offset = 0;
+  };
+
+  void run();
+  int writeChunk(const Chunk &chunk);
+  bool writeZeros(uint64_t size);
+  bool queue();
+  void stop(bool drain);
+
+  size_t m_chunkSize;
+  std::vector<Chunk> m_chunks;
+  int m_fd = -1;
+  bool m_direct = false;
+  uint64_t m_offset = 0;
+  std::chrono::microseconds m_stall{0};
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_ready;
+  std::condition_variable m_space;
+  std::thread m_thread;
+  size_t m_head = 0;
+  size_t m_tail = 0;
+  size_t m_queued = 0;
+  bool m_stopping = false;
+  bool m_abort = false;
+  int m_error = 0;
+};
+
+#endif
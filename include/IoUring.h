@@ -0,0 +1,89 @@
+#ifndef __IoUring_H__
+#define __IoUring_H__
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring wrapper on the raw system calls. Socket operations are
+// submitted and waited for synchronously by Socket; file operations are
+// fire-and-forget and only counted here, so whoever reaps the completion
+// queue keeps their bookkeeping up to date.
+class IoUring {
+ public:
+  IoUring() {}
+  ~IoUring();
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  bool init(unsigned entries);
+  bool valid() const { return m_fd != -1; }
+
+  // Next free submission entry, zeroed. Flushes the queue when it is full.
+  struct io_uring_sqe *sqe();
+  int submit(unsigned waitFor);
+
+  // Runs sendmsg/recvmsg for every message as one batch of SQEs and waits
+  // for them. Sets msg_len like sendmmsg/recvmmsg and returns the number of
+  // leading successful messages, or -1 with errno from the first one.
+  int transferMessages(uint8_t opcode, int fd, struct mmsghdr *messages,
+                       size_t count, bool link);
+
+  int registerBuffers(const struct iovec *buffers, unsigned count);
+  int unregisterBuffers();
+
+  // File operations carry their expected length in user_data.
+  void fileOpQueued() { ++m_filePending; }
+  unsigned pendingFileOps() const { return m_filePending; }
+  int waitFileOps();
+  int fileError() const { return m_fileError; }
+  void clearFileError() { m_fileError = 0; }
+
+ private:
+  static constexpr uint64_t m_socketTag = 1ull << 63;
+
+  template <typename Handler>
+  void reap(Handler &&handle) {
+    unsigned head = *m_cqHead;
+    while (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+      const struct io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+      if (cqe.user_data & m_socketTag) {
+        handle(cqe);
+      } else {
+        completeFileOp(cqe);
+      }
+      ++head;
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  }
+  void completeFileOp(const struct io_uring_cqe &cqe);
+
+  int m_fd = -1;
+  void *m_sqRing = nullptr;
+  void *m_cqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  size_t m_cqRingSize = 0;
+  struct io_uring_sqe *m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned *m_sqHead = nullptr;
+  unsigned *m_sqTail = nullptr;
+  unsigned *m_sqMask = nullptr;
+  unsigned *m_sqArray = nullptr;
+  unsigned m_sqEntries = 0;
+  unsigned m_sqeTail = 0;
+  unsigned m_toSubmit = 0;
+
+  unsigned *m_cqHead = nullptr;
+  unsigned *m_cqTail = nullptr;
+  unsigned *m_cqMask = nullptr;
+  struct io_uring_cqe *m_cqes = nullptr;
+
+  unsigned m_filePending = 0;
+  int m_fileError = 0;
+};
+
+#endif
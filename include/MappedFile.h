@@ -0,0 +1,51 @@
+#ifndef __MappedFile_H__
+#define __MappedFile_H__
+
+#include <setjmp.h>
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole regular file.
+class MappedFile {
+ public:
+  MappedFile() {}
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // `preload` faults the whole file in up front for mappings that are
+  // read over and over; otherwise pages are read ahead sequentially.
+  bool open(const std::string &path, bool preload = false);
+  void close();
+
+  bool isOpen() const { return m_open; }
+  const char *data() const { return m_data; }
+  size_t size() const { return m_size; }
+  // Runs `read` over bytes of a mapping. False when they lie past the end
+  // of a file truncated in place since, whose SIGBUS is caught here instead
+  // of killing the process. The kernel reading them fails with EFAULT.
+  template <typename Read>
+  static bool guarded(Read &&read) {
+    sigjmp_buf fault;
+    if (sigsetjmp(fault, 0) != 0) {
+      guard() = nullptr;
+      return false;
+    }
+    guard() = &fault;
+    read();
+    guard() = nullptr;
+    return true;
+  }
+
+ private:
+  // This thread's jump target for SIGBUS; the handler is installed on
+  // first use.
+  static sigjmp_buf *&guard();
+
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_open = false;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __MulticastSession_H__
+#define __MulticastSession_H__
+
+#include <RttEstimator.h>
+#include <TransferSession.h>
+#include <TransferStats.h>
+#include <UDPClient.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// RFC 2090 multicast read. Every client that asks for the same file
+// shares one transfer the server sends to a group; the server names one
+// master client at a time, which ACKs like a lock-step client, the others
+// keep what they overhear. Blocks therefore arrive in any order (a late
+// joiner starts mid-file), so they are tracked in a bitmap and written at
+// their offsets, and a client that becomes master only asks for its gaps:
+// it ACKs the block before the first one it is missing.
+//
+// Same event interface as TransferSession; the owner waits on both the
+// unicast socket and groupDescriptor(). Octet mode only.
+class MulticastSession {
+ public:
+  using status = TransferSession::status;
+  using Clock = TransferSession::Clock;
+
+  enum State { Idle, Requesting, Transferring, Done, Failed };
+
+  MulticastSession(Socket &socket, const std::string &ip, uint16_t port,
+                   const std::string &remoteFile,
+                   const std::string &localFile,
+                   const TransferOptions &options,
+                   const RttEstimator &rtt = RttEstimator());
+  ~MulticastSession();
+  MulticastSession(const MulticastSession &) = delete;
+  MulticastSession &operator=(const MulticastSession &) = delete;
+
+  status start(Clock::time_point now);
+  // Drains the unicast and the group socket.
+  void onReadable(Clock::time_point now);
+  bool onTimeout(Clock::time_point now);
+
+  // -1 until the group has been joined.
+  int groupDescriptor() const {
+    return m_group ? m_group->GetDescriptor() : -1;
+  }
+  bool finished() const { return m_state == Done || m_state == Failed; }
+  status result() const { return m_result; }
+  // The server answered without the multicast option, a plain get is
+  // needed instead.
+  bool declined() const { return m_declined; }
+  bool master() const { return m_master; }
+  Clock::time_point deadline() const { return m_deadline; }
+  const std::string &errorMessage() const { return m_errorMessage; }
+  const RttEstimator &rtt() const { return m_rtt; }
+  uint16_t blockSize() const { return m_blockSize; }
+  uint64_t transferredBytes() const { return m_bytes; }
+  const TransferStats &stats() const { return m_stats; }
+
+ private:
+  bool sendPacket(const char *packet, size_t size, const Endpoint *to);
+  bool sendRequest();
+  bool sendAck(uint32_t block);
+  bool sendError(uint16_t code, const std::string &message);
+  void receive(Socket &socket, bool group, Clock::time_point now);
+  void handlePacket(const char *packet, size_t size, Clock::time_point now);
+  void handleOptionAck(const OptionList &options, Clock::time_point now);
+  bool joinGroup(const std::string &address, uint16_t port);
+  void handleData(uint16_t block, const char *data, size_t payload,
+                  Clock::time_point now);
+  // The master's answer to whatever just arrived: the final ACK once the
+  // file is whole, otherwise a request for the first missing block.
+  void requestNext(Clock::time_point now);
+  bool received(uint32_t block) const;
+  bool complete() const {
+    return m_finalBlock != 0 && m_firstMissing > m_finalBlock;
+  }
+  void finish();
+  void fail(status code);
+  void finishStats();
+
+  Socket &m_socket;
+  std::unique_ptr<UDPSocket> m_group;
+  std::string m_remoteAddress;
+  uint16_t m_port;
+  std::string m_remoteFile;
+  std::string m_localFile;
+  TransferOptions m_options;
+  RttEstimator m_rtt;
+
+  Endpoint m_server;
+  Endpoint m_peer;
+  uint16_t m_remotePort = 0;
+  std::vector<char> m_request;
+  std::vector<char> m_buffer;
+  int m_file = -1;
+
+  State m_state = Idle;
+  status m_result = status::Success;
+  bool m_declined = false;
+  bool m_master = false;
+  uint16_t m_blockSize = TransferSession::m_defaultBlockSize;
+  // One bit per block, block n at bit n - 1.
+  std::vector<uint64_t> m_received;
+  uint32_t m_firstMissing = 1;
+  uint32_t m_highestBlock = 0;
+  uint32_t m_finalBlock = 0;
+  uint64_t m_bytes = 0;
+  uint64_t m_packets = 0;
+
+  int m_retries = 0;
+  Clock::time_point m_deadline;
+  Clock::time_point m_startTime;
+  Clock::time_point m_rttStart;
+  bool m_rttPending = false;
+  std::string m_errorMessage;
+  TransferStats m_stats;
+};
+
+#endif
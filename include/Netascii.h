@@ -0,0 +1,131 @@
+#ifndef __Netascii_H__
+#define __Netascii_H__
+
+#include <cstddef>
+#include <cstring>
+
+// Netascii line endings (RFC 1350, NVT ASCII of RFC 764): on the wire a
+// newline is CR LF and a bare CR is CR NUL. Local files use plain LF.
+//
+// The codecs copy runs of ordinary bytes in bulk and only stop at CR/LF.
+// Finding the next special byte is the Scanner policy; the vector ones test
+// 16 (SSE2) or 32 (AVX2) bytes per step, AVX2 chosen at run time unless
+// the build targets it.
+
+// Offset of the first CR (findCr) or of the first CR or LF (findLineEnd),
+// `size` when there is none.
+struct ScalarScanner {
+  static size_t findCr(const char *data, size_t size);
+  static size_t findLineEnd(const char *data, size_t size);
+};
+
+#if defined(__SSE2__)
+struct Sse2Scanner {
+  static size_t findCr(const char *data, size_t size);
+  static size_t findLineEnd(const char *data, size_t size);
+};
+
+// Built with the avx2 target attribute, safe to name without -mavx2 but
+// only to run on CPUs that have it.
+struct Avx2Scanner {
+  static size_t findCr(const char *data, size_t size);
+  static size_t findLineEnd(const char *data, size_t size);
+};
+
+// Avx2Scanner where the CPU has it, Sse2Scanner otherwise.
+struct DispatchScanner {
+  static size_t findCr(const char *data, size_t size);
+  static size_t findLineEnd(const char *data, size_t size);
+};
+#endif
+
+#if defined(__AVX2__)
+using DefaultScanner = Avx2Scanner;
+#elif defined(__SSE2__)
+using DefaultScanner = DispatchScanner;
+#else
+using DefaultScanner = ScalarScanner;
+#endif
+
+// Local text to netascii. Stateless: every CR and LF expands on its own.
+template <typename Scanner = DefaultScanner>
+struct NetasciiEncoder {
+  // Largest output for `size` input bytes.
+  static constexpr size_t maxEncoded(size_t size) { return 2 * size; }
+
+  static size_t encode(const char *in, size_t size, char *out) {
+    char *next = out;
+    while (size > 0) {
+      const size_t run = Scanner::findLineEnd(in, size);
+      std::memcpy(next, in, run);
+      next += run;
+      in += run;
+      size -= run;
+      if (size == 0) break;
+      *next++ = '\r';
+      *next++ = *in == '\n' ? '\n' : '\0';
+      ++in;
+      --size;
+    }
+    return next - out;
+  }
+};
+
+// Netascii to local text. A CR that ends one block is held back until the
+// next block shows whether it was CR LF or CR NUL.
+template <typename Scanner = DefaultScanner>
+class NetasciiDecoder {
+ public:
+  // Largest output for `size` input bytes, including a held back CR.
+  static constexpr size_t maxDecoded(size_t size) { return size + 1; }
+
+  void reset() { m_pendingCr = false; }
+
+  size_t decode(const char *in, size_t size, char *out) {
+    char *next = out;
+    if (m_pendingCr && size > 0) {
+      m_pendingCr = false;
+      next = translateCr(*in, next);
+      if (*in == '\n' || *in == '\0') {
+        ++in;
+        --size;
+      }
+    }
+    while (size > 0) {
+      const size_t run = Scanner::findCr(in, size);
+      std::memcpy(next, in, run);
+      next += run;
+      in += run;
+      size -= run;
+      if (size == 0) break;
+      if (size == 1) {
+        m_pendingCr = true;
+        break;
+      }
+      // CR followed by anything else is passed through unchanged.
+      next = translateCr(in[1], next);
+      const bool pair = in[1] == '\n' || in[1] == '\0';
+      in += pair ? 2 : 1;
+      size -= pair ? 2 : 1;
+    }
+    return next - out;
+  }
+
+  // Flushes a CR that ended the last block.
+  size_t finish(char *out) {
+    if (!m_pendingCr) return 0;
+    m_pendingCr = false;
+    *out = '\r';
+    return 1;
+  }
+
+ private:
+  static char *translateCr(char following, char *out) {
+    *out++ = following == '\n' ? '\n' : '\r';
+    return out;
+  }
+
+  bool m_pendingCr = false;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef __Packet_H__
+#define __Packet_H__
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// TFTP wire format: RFC 1350 packets and RFC 2347 options. Encoders write
+// into a buffer the caller owns and return the packet size, 0 when it
+// doesn't fit; PacketView decodes a datagram in place. Neither copies nor
+// allocates, so DATA and ACK handling stays off the heap.
+class Packet {
+ public:
+  enum OperationCode : uint16_t { RRQ = 1, WRQ, DATA, ACK, ERR, OACK };
+
+  struct Operation {
+    const char *name;
+    // Opcode plus fixed fields; strings are checked separately.
+    size_t minSize;
+  };
+
+  struct Option {
+    std::string_view name;
+    std::string_view value;
+  };
+
+  // Decimal option value on the stack.
+  class Number {
+   public:
+    explicit Number(uint64_t value)
+        : m_size(std::to_chars(m_text, m_text + sizeof(m_text), value).ptr -
+                 m_text) {}
+    std::string_view view() const { return std::string_view(m_text, m_size); }
+
+   private:
+    char m_text[20];
+    size_t m_size;
+  };
+
+  static constexpr size_t m_opcodeSize = 2;
+  static constexpr size_t m_headerSize = 4;
+  static constexpr std::array<Operation, OACK + 1> m_operations = {{
+      {"unknown", 0},
+      {"RRQ", m_opcodeSize},
+      {"WRQ", m_opcodeSize},
+      {"DATA", m_headerSize},
+      {"ACK", m_headerSize},
+      {"ERROR", m_headerSize},
+      {"OACK", m_opcodeSize},
+  }};
+
+  static constexpr bool known(uint16_t code) {
+    return code >= RRQ && code <= OACK;
+  }
+  static constexpr const char *name(uint16_t code) {
+    return m_operations[known(code) ? code : 0].name;
+  }
+
+  // RRQ or WRQ: file, mode, then the options.
+  static constexpr size_t requestSize(std::string_view file,
+                                      std::string_view mode,
+                                      std::span<const Option> options = {}) {
+    return m_opcodeSize + file.size() + 1 + mode.size() + 1 +
+           optionsSize(options);
+  }
+  static constexpr size_t optionsSize(std::span<const Option> options) {
+    size_t size = 0;
+    for (const Option &option : options) {
+      size += option.name.size() + 1 + option.value.size() + 1;
+    }
+    return size;
+  }
+
+  static size_t request(std::span<char> out, OperationCode code,
+                        std::string_view file, std::string_view mode,
+                        std::span<const Option> options = {});
+  // Only the header, for payloads sent from their own buffer.
+  static size_t dataHeader(std::span<char> out, uint16_t block);
+  static size_t data(std::span<char> out, uint16_t block,
+                     std::span<const char> payload);
+  static size_t ack(std::span<char> out, uint16_t block);
+  static size_t error(std::span<char> out, uint16_t code,
+                      std::string_view message);
+  static size_t optionAck(std::span<char> out,
+                          std::span<const Option> options);
+
+  // Option names are case-insensitive (RFC 2347).
+  static bool sameName(std::string_view name, std::string_view wanted);
+  // The whole of `text` as a decimal number.
+  static bool parseNumber(std::string_view text, uint64_t &value);
+};
+
+// Name/value pairs of a request or OACK. The strings were checked to be
+// NUL terminated when the packet was parsed; a trailing name without a
+// value is left out.
+class OptionList {
+ public:
+  class iterator {
+   public:
+    using value_type = Packet::Option;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(const char *at) : m_at(at) {}
+    Packet::Option operator*() const;
+    iterator &operator++();
+    iterator operator++(int) {
+      iterator previous = *this;
+      ++*this;
+      return previous;
+    }
+    bool operator==(const iterator &other) const = default;
+
+   private:
+    const char *m_at = nullptr;
+  };
+
+  OptionList() = default;
+  OptionList(const char *begin, const char *end)
+      : m_begin(begin), m_end(end) {}
+
+  iterator begin() const { return iterator(m_begin); }
+  iterator end() const { return iterator(m_end); }
+  bool empty() const { return m_begin == m_end; }
+  // Value of the option called `name`, false when there is none.
+  bool find(std::string_view name, std::string_view &value) const;
+
+ private:
+  const char *m_begin = nullptr;
+  const char *m_end = nullptr;
+};
+
+// A received datagram, decoded in place: the views point into it and are
+// only valid as long as its buffer.
+class PacketView {
+ public:
+  enum Result { Valid, Truncated, UnknownOperation, Unterminated };
+
+  Result parse(std::span<const char> datagram);
+
+  // Also set when parse() fails with UnknownOperation.
+  uint16_t operation() const { return m_operation; }
+  // DATA and ACK.
+  uint16_t block() const { return m_number; }
+  std::span<const char> payload() const { return m_payload; }
+  // ERROR.
+  uint16_t errorCode() const { return m_number; }
+  std::string_view errorMessage() const { return m_first; }
+  // RRQ and WRQ.
+  std::string_view file() const { return m_first; }
+  std::string_view mode() const { return m_second; }
+  // RRQ, WRQ and OACK.
+  const OptionList &options() const { return m_options; }
+
+ private:
+  uint16_t m_operation = 0;
+  uint16_t m_number = 0;
+  std::span<const char> m_payload;
+  std::string_view m_first;
+  std::string_view m_second;
+  OptionList m_options;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __ProgressRenderer_H__
+#define __ProgressRenderer_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Counters a transfer publishes per block. Relaxed atomics: readers only
+// want a recent value, not a consistent snapshot.
+struct TransferProgress {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint32_t> blocks{0};
+};
+
+// Redraws one progress line at a fixed rate from its own thread, so the
+// transfer loop never formats or prints anything per block.
+class ProgressRenderer {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Output = std::function<void(const std::string &)>;
+
+  ProgressRenderer(const TransferProgress &progress, bool receiving,
+                   Output output,
+                   std::chrono::milliseconds interval =
+                       std::chrono::milliseconds(250));
+  ~ProgressRenderer();
+  ProgressRenderer(const ProgressRenderer &) = delete;
+  ProgressRenderer &operator=(const ProgressRenderer &) = delete;
+
+  void start();
+  // Draws the final state and ends the line.
+  void stop();
+
+ private:
+  void run();
+  void draw(Clock::time_point now);
+
+  const TransferProgress &m_progress;
+  const bool m_receiving;
+  const std::chrono::milliseconds m_interval;
+  Output m_output;
+  Clock::time_point m_start;
+  uint64_t m_drawnBytes = 0;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stopping = false;
+  std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __RttEstimator_H__
+#define __RttEstimator_H__
+
+#include <chrono>
+
+// Retransmission timeout estimator after RFC 6298: smoothed RTT and RTT
+// variance from samples, exponential backoff on timeouts.
+class RttEstimator {
+ public:
+  using Duration = std::chrono::microseconds;
+
+  RttEstimator();
+
+  void sample(Duration rtt);
+  void backoff();
+  // Undoes the backoff: the timeout goes back to what the samples give.
+  void settle();
+  void reset();
+
+  Duration timeout() const { return m_rto; }
+  Duration smoothed() const { return m_srtt; }
+  bool hasSample() const { return m_hasSample; }
+
+ private:
+  Duration estimate() const;
+
+  static constexpr Duration m_initialRto = std::chrono::seconds(1);
+  static constexpr Duration m_minRto = std::chrono::milliseconds(20);
+  static constexpr Duration m_maxRto = std::chrono::seconds(60);
+  static constexpr Duration m_granularity = std::chrono::milliseconds(1);
+
+  Duration m_srtt;
+  Duration m_rttvar;
+  Duration m_rto;
+  bool m_hasSample;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __SparseFile_H__
+#define __SparseFile_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Bookkeeping for a download that leaves all-zero blocks unwritten. The
+// file is created empty, so skipped bytes already read back as zeros; at
+// the end it only needs its final size, and where it was reserved up front
+// with fallocate() the skipped stretches are punched back out so they take
+// no space.
+class SparseFile {
+ public:
+  // Holes are only punched in whole pages.
+  static constexpr uint64_t m_pageSize = 4096;
+
+  // SSE2, or AVX2 where the CPU has it; stops at the first non-zero byte.
+  static bool isZero(const char *data, size_t size);
+
+  // Reserves `size` bytes for `fd`; false where the file system can't.
+  bool preallocate(int fd, uint64_t size);
+  bool preallocated() const { return m_preallocated; }
+  // [offset, offset + size) is zeros and was not written.
+  void skip(uint64_t offset, uint64_t size);
+  uint64_t skippedBytes() const { return m_skipped; }
+  // Sets the size to `size` and frees what was reserved for the skipped
+  // stretches. Every write must have reached the file.
+  bool finish(int fd, uint64_t size);
+  void reset();
+
+ private:
+  bool m_preallocated = false;
+  uint64_t m_skipped = 0;
+  // Skipped stretches, adjacent blocks merged.
+  std::vector<std::pair<uint64_t, uint64_t>> m_runs;
+};
+
+#endif
@@ -1,76 +1,106 @@
 #ifndef __TFTPClient_H__
 #define __TFTPClient_H__
 
+#include <AsyncLogger.h>
+#include <MulticastSession.h>
+#include <RttEstimator.h>
+#include <TransferSession.h>
 #include <UDPClient.h>
 
-#include <array>
+#include <algorithm>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 using boost::format;
 using namespace boost::posix_time;
 
 class TFTPClient : public UDPClient {
-  enum OperationCode {
-    RRQ = 1,
-    WRQ,
-    DATA,
-    ACK,
-    ERR,
-    OACK
-  };
-
  public:
-  enum status {
-    Success = 0,
-    InvalidSocket,
-    WriteError,
-    ReadError,
-    UnexpectedPacketReceived,
-    EmptyFilename,
-    OpenFileError,
-    WriteFileError,
-    ReadFileError,
-    TimeOut
-  };
+  using status = TransferSession::status;
 
   TFTPClient() {}
-  TFTPClient(std::string ip, int port, std::string mode);
-  ~TFTPClient() {
-    logfile.flush();
-    logfile.close();
-  }
+  // `log` may be shared with other clients, e.g. a pool's workers; without
+  // one the client opens its own.
+  TFTPClient(std::string ip, int port, std::string mode,
+             std::shared_ptr<AsyncLogger> log = nullptr);
+  ~TFTPClient() {}
+
+  // A logger on a new logs/<time>.log.
+  static std::shared_ptr<AsyncLogger> openLog();
+  const std::shared_ptr<AsyncLogger> &log() const { return m_log; }
 
   void changeMode(const std::string &mode);
+  bool setBlockSize(uint16_t blockSize);
+  uint16_t blockSize() const { return m_blockSize; }
+  bool setWindowSize(uint16_t windowSize);
+  uint16_t windowSize() const { return m_windowSize; }
+  void setOffload(bool offload) { m_options.offload = offload; }
+  // get: leave all-zero blocks as holes in the local file.
+  void setSparse(bool sparse) { m_options.sparse = sparse; }
+  // Upload rate cap in bits per second, 0 for none.
+  void setRate(uint64_t bitsPerSecond) { m_options.rateLimit = bitsPerSecond; }
+  // Checksum computed on the data path; a get fails with DigestMismatch
+  // when `expected` is given and differs.
+  void setDigest(Digest::Algorithm algorithm,
+                 const std::string &expected = std::string()) {
+    m_options.digest = algorithm;
+    m_options.expectedDigest = expected;
+  }
+  bool setBackend(Socket::Backend backend);
+  void setWriteBehind(bool writeBehind, bool directIo = false) {
+    m_options.writeBehind = writeBehind;
+    m_options.directIo = writeBehind && directIo;
+  }
+  void setOptions(const TransferOptions &options) { m_options = options; }
+  const TransferOptions &options() const { return m_options; }
+  void setVerbose(bool verbose) { m_verbose = verbose; }
+  // Where progress and result messages go; nothing is printed without one.
+  void setOutput(ProgressRenderer::Output output) {
+    m_output = std::move(output);
+  }
+  uint64_t lastTransferredBytes() const { return m_lastBytes; }
+  const TransferStats &lastStats() const { return m_lastStats; }
   void writeLog(const std::string Message);
   status get(const std::string &fileName);
+  status get(const std::string &remoteFile, const std::string &localFile);
+  status get(const std::string &remoteFile, std::shared_ptr<DataSink> sink);
+  // RFC 2090: shares one multicast transfer with every other client of
+  // the file. Netascii, and servers without multicast, get plain unicast.
+  status getMulticast(const std::string &remoteFile,
+                      const std::string &localFile);
   status put(const std::string &fileName);
-  std::string errorDescription(status code);
+  status put(const std::string &localFile, const std::string &remoteFile);
+  status put(std::shared_ptr<DataSource> source,
+             const std::string &remoteFile);
+  static std::string errorDescription(status code);
 
  private:
-  static constexpr uint8_t m_headerSize = 4;
-  static constexpr uint16_t m_dataSize = 512;
-
-  using Result = std::pair<status, int32_t>;
-  using Buffer = std::array<char, m_headerSize + m_dataSize>;
-
-  Result sendRequest(const std::string &fileName, OperationCode code);
-  Result sendAck();
-  Result read();
-  Result getFile(std::fstream &file, const ptime &startime, double &loseper);
-  Result putFile(std::fstream &file, const ptime &startime, double &loseper);
+  status transfer(TransferSession::Direction direction,
+                  const std::string &remoteFile, const std::string &localFile,
+                  const TransferOptions &options);
+  void report(bool isGet, uint64_t bytes, double losePercent,
+              TransferSession::Clock::time_point startTime);
+  void print(const std::string &message) {
+    if (m_verbose && m_output) m_output(message);
+  }
 
-  std::fstream logfile;
+  std::shared_ptr<AsyncLogger> m_log;
   UDPClient m_socket;
   std::string m_remoteAddress;
-  std::string m_mode;
   uint16_t m_port;
-  uint16_t m_remotePort;
-  Buffer m_buffer;
-  uint16_t m_receivedBlock;
+  TransferOptions m_options;
+  RttEstimator m_rtt;
+  uint16_t m_blockSize = TransferSession::m_defaultBlockSize;
+  uint16_t m_windowSize = 1;
+  uint64_t m_lastBytes = 0;
+  TransferStats m_lastStats;
+  bool m_verbose = true;
+  ProgressRenderer::Output m_output;
 };
 
-#endif
\ No newline at end of file
+#endif
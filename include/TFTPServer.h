@@ -0,0 +1,61 @@
+#ifndef __TFTPServer_H__
+#define __TFTPServer_H__
+
+#include <TransferSession.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ServerOptions {
+  std::string root = ".";
+  std::string address = "0.0.0.0";
+  uint16_t port = 69;
+  size_t workers = 1;
+  // Upper bounds for what clients may negotiate. The window is kept small
+  // so thousands of sessions stay cheap.
+  uint16_t maxBlockSize = TransferSession::m_maxBlockSize;
+  uint16_t maxWindowSize = 64;
+  // WRQs may create or replace files under root; off unless asked for.
+  bool allowWrite = false;
+  // Byte budget of each worker's hot-file cache.
+  uint64_t cacheBytes = uint64_t(1) << 30;
+};
+
+// Multi-core TFTP server. Every worker thread owns a SO_REUSEPORT listener
+// on the server port, a TransferEngine with its sessions and a FileCache,
+// and answers each request from a new socket (the transfer ID). Workers
+// share nothing; the kernel spreads clients over their listeners.
+class TFTPServer {
+ public:
+  struct Totals {
+    uint64_t transfers = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    uint64_t cacheHits = 0;
+    uint64_t cacheMisses = 0;
+  };
+
+  explicit TFTPServer(const ServerOptions &options);
+  ~TFTPServer();
+  TFTPServer(const TFTPServer &) = delete;
+  TFTPServer &operator=(const TFTPServer &) = delete;
+
+  // False when the address can't be resolved or a listener can't be bound.
+  bool start();
+  // Aborts running transfers and joins the workers.
+  void stop();
+
+  size_t workers() const { return m_workers.size(); }
+  // Complete once stopped.
+  Totals totals() const;
+
+ private:
+  class Worker;
+
+  ServerOptions m_options;
+  std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+#endif
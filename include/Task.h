@@ -0,0 +1,124 @@
+#ifndef __Task_H__
+#define __Task_H__
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Lazily started coroutine returning T. Awaiting a Task starts it and
+// resumes the awaiting coroutine when it finishes (symmetric transfer, so
+// long chains of awaits don't grow the stack).
+template <typename T>
+class Task;
+
+namespace detail {
+
+template <typename Promise>
+struct FinalAwaiter {
+  bool await_ready() noexcept { return false; }
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> finished) noexcept {
+    const std::coroutine_handle<> continuation =
+        finished.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+  void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+  std::exception_ptr error;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  void unhandled_exception() { error = std::current_exception(); }
+};
+
+}  // namespace detail
+
+template <typename T>
+class Task {
+ public:
+  struct promise_type : detail::PromiseBase {
+    std::optional<T> value;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    detail::FinalAwaiter<promise_type> final_suspend() noexcept { return {}; }
+    void return_value(T result) { value = std::move(result); }
+  };
+
+  Task(Task &&other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (m_handle) m_handle.destroy();
+      m_handle = std::exchange(other.m_handle, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (m_handle) m_handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+  }
+  T await_resume() {
+    if (m_handle.promise().error) {
+      std::rethrow_exception(m_handle.promise().error);
+    }
+    return std::move(*m_handle.promise().value);
+  }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle) {}
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+template <>
+class Task<void> {
+ public:
+  struct promise_type : detail::PromiseBase {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    detail::FinalAwaiter<promise_type> final_suspend() noexcept { return {}; }
+    void return_void() {}
+  };
+
+  Task(Task &&other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (m_handle) m_handle.destroy();
+      m_handle = std::exchange(other.m_handle, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (m_handle) m_handle.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+  }
+  void await_resume() {
+    if (m_handle.promise().error) {
+      std::rethrow_exception(m_handle.promise().error);
+    }
+  }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle)
+      : m_handle(handle) {}
+
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+#endif
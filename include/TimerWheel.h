@@ -0,0 +1,70 @@
+#ifndef __TimerWheel_H__
+#define __TimerWheel_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Hashed timer wheel keyed by session id. Rescheduling to a later deadline
+// is free: the old entry stays in place and is re-armed when it fires, so
+// per-packet deadline updates cost nothing.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds(2),
+                      size_t slots = 4096);
+
+  // Ensures expired(id) is called no later than one tick after `when`.
+  void schedule(uint64_t id, Clock::time_point when);
+  void cancel(uint64_t id);
+
+  template <typename Expired>
+  void advance(Clock::time_point now, Expired &&expired) {
+    const uint64_t nowTick = toTick(now, false);
+    if (m_scheduled.empty()) m_current = std::max(m_current, nowTick + 1);
+    while (m_current <= nowTick) {
+      const uint64_t tick = m_current++;
+      std::vector<Entry> &slot = m_slots[tick % m_slots.size()];
+      m_due.swap(slot);
+      for (const Entry &entry : m_due) {
+        if (entry.second > tick) {
+          slot.push_back(entry);
+          continue;
+        }
+        const auto live = m_scheduled.find(entry.first);
+        if (live == m_scheduled.end() || live->second != entry.second) {
+          continue;
+        }
+        m_scheduled.erase(live);
+        expired(entry.first);
+      }
+      m_due.clear();
+    }
+  }
+
+  // Until the earliest occupied slot is due, at most one turn of the
+  // wheel; zero when it already is.
+  Clock::duration untilNext(Clock::time_point now) const;
+
+  bool empty() const { return m_scheduled.empty(); }
+  size_t size() const { return m_scheduled.size(); }
+  Clock::duration tick() const { return m_tick; }
+
+ private:
+  using Entry = std::pair<uint64_t, uint64_t>;
+
+  uint64_t toTick(Clock::time_point when, bool roundUp) const;
+
+  Clock::duration m_tick;
+  Clock::time_point m_origin;
+  uint64_t m_current = 0;
+  std::vector<std::vector<Entry>> m_slots;
+  std::vector<Entry> m_due;
+  std::unordered_map<uint64_t, uint64_t> m_scheduled;
+};
+
+#endif
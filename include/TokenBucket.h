@@ -0,0 +1,29 @@
+#ifndef __TokenBucket_H__
+#define __TokenBucket_H__
+
+#include <chrono>
+#include <cstdint>
+
+// Token bucket pacer: tokens (bytes) refill at `rate` per second up to
+// `burst`, and a packet may go once the bucket holds its size. A small
+// burst spreads packets evenly instead of sending windows back to back.
+class TokenBucket {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Rate 0 disables pacing.
+  void setRate(uint64_t bytesPerSecond, uint64_t burst);
+  uint64_t rate() const { return m_rate; }
+
+  // Zero when `bytes` may be sent now (and takes the tokens), otherwise how
+  // long until they may.
+  Clock::duration reserve(uint64_t bytes, Clock::time_point now);
+
+ private:
+  uint64_t m_rate = 0;
+  double m_burst = 0;
+  double m_tokens = 0;
+  Clock::time_point m_updated;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __TransferEngine_H__
+#define __TransferEngine_H__
+
+#include <TimerWheel.h>
+#include <TransferSession.h>
+#include <UDPClient.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Runs many TransferSessions on one thread: every session has its own
+// non-blocking UDP socket registered with epoll, and retransmission
+// deadlines live in a shared timer wheel.
+class TransferEngine {
+ public:
+  using Id = uint64_t;
+  using Completion = std::function<void(Id, const TransferSession &)>;
+  using SocketFactory = std::function<std::unique_ptr<UDPClient>(
+      const std::string &ip, uint16_t port)>;
+  using Task = std::function<void()>;
+
+  TransferEngine();
+  ~TransferEngine();
+  TransferEngine(const TransferEngine &) = delete;
+  TransferEngine &operator=(const TransferEngine &) = delete;
+
+  // Starts a transfer. The completion runs on the engine thread, also when
+  // the transfer fails right away (e.g. the local file can't be opened).
+  Id submit(TransferSession::Direction direction, const std::string &ip,
+            uint16_t port, const std::string &remoteFile,
+            const std::string &localFile, const TransferOptions &options,
+            Completion done);
+
+  // Takes over a session its owner already started on `socket`, e.g. one a
+  // server accepted.
+  Id adopt(std::unique_ptr<UDPClient> socket,
+           std::unique_ptr<TransferSession> session, Completion done);
+
+  void cancel(Id id, TransferSession::status code);
+
+  // Calls `onReadable` on the engine thread whenever `fd` is readable.
+  Id watch(int fd, Task onReadable);
+  void unwatch(Id id);
+
+  // Replaces how sockets for new transfers are created.
+  void setSocketFactory(SocketFactory factory) {
+    m_socketFactory = std::move(factory);
+  }
+
+  // The only thread-safe call: queues a task for the engine thread and
+  // wakes its poll().
+  void post(Task task);
+
+  // Waits at most timeoutMs (-1: until something happens) and dispatches
+  // socket and timer events and posted tasks. Returns false once no
+  // transfer is active; with nothing active and timeoutMs -1 it returns at
+  // once instead of waiting for a post(), unless a descriptor is watched.
+  bool poll(int timeoutMs = -1);
+  void run();
+
+  size_t active() const { return m_sessions.size(); }
+
+ private:
+  struct Entry {
+    std::unique_ptr<UDPClient> socket;
+    std::unique_ptr<TransferSession> session;
+    Completion done;
+  };
+
+  void settle(Id id, Entry &entry);
+  void runPosted();
+
+  static constexpr int m_maxEvents = 256;
+  // epoll data of the wakeup eventfd, transfer ids start at 1.
+  static constexpr Id m_wakeupId = 0;
+
+  int m_epoll;
+  int m_wakeup;
+  SocketFactory m_socketFactory;
+  std::mutex m_postMutex;
+  std::vector<Task> m_posted;
+  Id m_nextId = 1;
+  TimerWheel m_timers;
+  std::unordered_map<Id, Entry> m_sessions;
+  std::unordered_map<Id, std::pair<int, Task>> m_watches;
+};
+
+#endif
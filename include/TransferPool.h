@@ -0,0 +1,77 @@
+#ifndef __TransferPool_H__
+#define __TransferPool_H__
+
+#include <AsyncLogger.h>
+#include <TransferSession.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fans get/put requests out over worker threads. Every worker owns its own
+// TFTPClient, hence its own socket and transfer ID towards the server; they
+// all write to one log.
+class TransferPool {
+ public:
+  struct Task {
+    TransferSession::Direction direction;
+    std::string fileName;
+    TransferOptions options;
+    // Where get writes and put reads; the remote name when empty.
+    std::string localFile;
+  };
+
+  struct Summary {
+    size_t succeeded = 0;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+  };
+
+  // Called by the workers as their tasks finish, concurrently.
+  using Report = std::function<void(const Task &, TransferSession::status,
+                                    const TransferStats &)>;
+
+  // Without a `log` the pool opens one of its own.
+  TransferPool(const std::string &ip, uint16_t port, size_t workers,
+               Report report = Report(),
+               std::shared_ptr<AsyncLogger> log = nullptr);
+  ~TransferPool();
+  TransferPool(const TransferPool &) = delete;
+  TransferPool &operator=(const TransferPool &) = delete;
+
+  void submit(Task task);
+  // Blocks until every submitted task has finished and returns the totals
+  // since the previous wait().
+  Summary wait();
+
+  size_t workers() const { return m_workers.size(); }
+
+ private:
+  void work();
+
+  std::string m_remoteAddress;
+  uint16_t m_port;
+  Report m_report;
+  std::shared_ptr<AsyncLogger> m_log;
+
+  std::mutex m_mutex;
+  std::condition_variable m_queued;
+  std::condition_variable m_idle;
+  std::deque<Task> m_tasks;
+  size_t m_running = 0;
+  bool m_stopping = false;
+  bool m_started = false;
+  std::chrono::steady_clock::time_point m_startTime;
+  Summary m_summary;
+
+  std::vector<std::thread> m_workers;
+};
+
+#endif
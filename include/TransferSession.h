@@ -0,0 +1,305 @@
+#ifndef __TransferSession_H__
+#define __TransferSession_H__
+
+#include <CongestionControl.h>
+#include <DataStream.h>
+#include <Digest.h>
+#include <FileWriter.h>
+#include <MappedFile.h>
+#include <Netascii.h>
+#include <Packet.h>
+#include <ProgressRenderer.h>
+#include <RttEstimator.h>
+#include <SparseFile.h>
+#include <TokenBucket.h>
+#include <TransferStats.h>
+#include <UDPClient.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct TransferOptions {
+  std::string mode = "octet";
+  uint16_t blockSize = 1468;
+  uint16_t windowSize = 8;
+  // UDP GSO on put and GRO on get, where the kernel supports them.
+  bool offload = false;
+  // io_uring batches socket I/O and, on get, queues the file writes.
+  Socket::Backend backend = Socket::SyscallBackend;
+  // get: a writer thread takes file writes off the ACK path, optionally
+  // with O_DIRECT.
+  bool writeBehind = true;
+  bool directIo = false;
+  // Instead of the local file, get writes into `sink` and put reads from
+  // `source` (stdin/stdout, pipes, memory).
+  std::shared_ptr<DataSink> sink;
+  std::shared_ptr<DataSource> source;
+  // put: bits per second, 0 for no cap. Congestion control paces below it
+  // when the path shows loss.
+  uint64_t rateLimit = 0;
+  bool congestionControl = true;
+  // Checksum of the local bytes, computed as blocks pass. get fails with
+  // DigestMismatch when it differs from `expectedDigest` ("algorithm:hex").
+  Digest::Algorithm digest = Digest::NoDigest;
+  std::string expectedDigest;
+  // get into a file: all-zero blocks are not written but left as holes.
+  // Octet gets also ask for the size (RFC 2349 tsize) and reserve it.
+  bool sparse = true;
+  // get: only ask for the size (RFC 2349 tsize) and turn the transfer down
+  // once the server has answered. No local file is touched; the size ends
+  // up in the stats.
+  bool probe = false;
+};
+
+// One RRQ/WRQ transfer as a non-blocking state machine. The owner waits for
+// the socket and the deadline and feeds the session readiness and timer
+// events; the session itself never blocks.
+class TransferSession {
+ public:
+  using OperationCode = Packet::OperationCode;
+
+  enum status {
+    Success = 0,
+    InvalidSocket,
+    WriteError,
+    ReadError,
+    UnexpectedPacketReceived,
+    EmptyFilename,
+    OpenFileError,
+    WriteFileError,
+    ReadFileError,
+    TimeOut,
+    Cancelled,
+    DigestMismatch
+  };
+
+  enum Direction { Get, Put };
+  enum State { Idle, Requesting, Transferring, Done, Failed };
+
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr uint8_t m_headerSize = Packet::m_headerSize;
+  static constexpr uint16_t m_defaultBlockSize = 512;
+  static constexpr uint16_t m_minBlockSize = 8;
+  static constexpr uint16_t m_maxBlockSize = 65464;
+  static constexpr int m_maxRetries = 6;
+  // A session gives up after this many of the peer's retransmission
+  // intervals without progress.
+  static constexpr int m_giveUpTimeouts = 8;
+  // Datagrams per sendmmsg/recvmmsg call.
+  static constexpr size_t m_maxBurst = 64;
+  // Receive buffers when GRO may hand over up to 64 KB per read.
+  static constexpr size_t m_coalescedBuffers = 8;
+  static constexpr size_t m_coalescedBufferSize = 65535;
+  // Pacing granularity, about the engine's timer tick.
+  static constexpr std::chrono::milliseconds m_pacingQuantum{2};
+
+  TransferSession(Socket &socket, const std::string &ip, uint16_t port,
+                  Direction direction, const std::string &remoteFile,
+                  const std::string &localFile, const TransferOptions &options,
+                  const RttEstimator &rtt = RttEstimator());
+  ~TransferSession();
+  TransferSession(const TransferSession &) = delete;
+  TransferSession &operator=(const TransferSession &) = delete;
+
+  status start(Clock::time_point now);
+  // Server side: answers a parsed and negotiated request from `client` on
+  // this session's own socket (its transfer ID). Put serves an RRQ, Get
+  // takes a WRQ. `optionAck` is the OACK to send, empty for a plain
+  // RFC 1350 answer; `source` optionally shares the mapping to serve.
+  status accept(Clock::time_point now, const Endpoint &client,
+                uint16_t blockSize, uint16_t windowSize,
+                const std::string &optionAck,
+                std::shared_ptr<const MappedFile> source = nullptr);
+  void onReadable(Clock::time_point now);
+  bool onTimeout(Clock::time_point now);
+  void cancel(status code);
+
+  bool finished() const { return m_state == Done || m_state == Failed; }
+  State state() const { return m_state; }
+  status result() const { return m_result; }
+  Direction direction() const { return m_direction; }
+  // Retransmission deadline, or earlier when paced blocks are due.
+  Clock::time_point deadline() const {
+    return m_pacePending ? std::min(m_deadline, m_paceAt) : m_deadline;
+  }
+  const std::string &remoteFile() const { return m_remoteFile; }
+  const std::string &localFile() const { return m_localFile; }
+  const std::string &errorMessage() const { return m_errorMessage; }
+  const RttEstimator &rtt() const { return m_rtt; }
+  uint16_t blockSize() const { return m_blockSize; }
+  uint16_t windowSize() const { return m_windowSize; }
+  uint64_t transferredBytes() const { return m_bytes; }
+  uint32_t transferredBlocks() const { return m_blocks; }
+  double losePercent() const;
+  // Complete once the session has finished.
+  const TransferStats &stats() const { return m_stats; }
+  // Optional counters mirrored for readers on other threads.
+  void setProgress(TransferProgress *progress) { m_progress = progress; }
+
+ private:
+  using Buffer = std::vector<char>;
+  using Header = std::array<char, m_headerSize>;
+
+  bool openFiles();
+  void allocateBuffers(uint16_t blockSize, uint16_t windowSize);
+  void buildRequest();
+  bool sendPacket(const char *packet, size_t size, const Endpoint *to);
+  bool acceptSource(const Endpoint &source);
+  // Null once connected: send() instead of sendto().
+  const Endpoint *peer() const {
+    return m_socket.IsConnected() ? nullptr : &m_peer;
+  }
+  bool sendBurst(Datagram *burst, size_t &count);
+  bool checkSent(int sendNums, size_t size);
+  bool sendRequest();
+  bool sendAck(uint16_t block);
+  void handlePacket(const char *packet, size_t size, Clock::time_point now);
+  void handleData(const char *data, size_t payload, Clock::time_point now);
+  bool storeData(const char *data, size_t size);
+  bool skipZeros(size_t size);
+  void preallocate();
+  bool finishSparse();
+  void finishProbe(uint16_t error, const char *message);
+  void handleAck(uint16_t block, Clock::time_point now);
+  void handleOptionAck(const OptionList &options, Clock::time_point now);
+  bool parseOptions(const OptionList &options);
+  void beginPut(Clock::time_point now);
+  void fillWindow(Clock::time_point now);
+  void updatePacer();
+  std::streamsize readRaw(char *out, size_t size);
+  std::streamsize readBlock(char *out);
+  bool openUringTarget();
+  bool queueWrite(const char *data, size_t size, uint64_t offset);
+  bool flushWrites();
+  void closeFiles();
+  void firstByte(Clock::time_point now) {
+    if (m_stats.firstByte) return;
+    m_stats.firstByte = true;
+    m_stats.timeToFirstByte =
+        std::chrono::duration_cast<TransferStats::Duration>(now - m_startTime);
+  }
+  void addDiskStall(Clock::time_point since) {
+    m_stats.diskStall += std::chrono::duration_cast<TransferStats::Duration>(
+        Clock::now() - since);
+  }
+  void finishStats();
+  void complete();
+  void fail(status code);
+  void sendError(status code);
+  void publishProgress() {
+    if (m_progress == nullptr) return;
+    m_progress->bytes.store(m_bytes, std::memory_order_relaxed);
+    m_progress->blocks.store(m_blocks, std::memory_order_relaxed);
+  }
+  void startRttSample(Clock::time_point now);
+  void finishRttSample(Clock::time_point now);
+
+  Socket &m_socket;
+  std::string m_remoteAddress;
+  uint16_t m_port;
+  // Server address for the request and the transfer ID it answered from.
+  Endpoint m_server;
+  Endpoint m_peer;
+  uint16_t m_remotePort = 0;
+  Direction m_direction;
+  std::string m_remoteFile;
+  std::string m_localFile;
+  TransferOptions m_options;
+  Digest m_digest;
+  std::fstream m_file;
+  // netascii: decoded DATA payloads on get, the encoded file on put.
+  bool m_netascii = false;
+  NetasciiDecoder<> m_decoder;
+  Buffer m_translated;
+  Buffer m_raw;
+  Buffer m_encoded;
+  size_t m_encodedBegin = 0;
+  size_t m_encodedEnd = 0;
+  bool m_rawEnd = false;
+  // get: the size the server announced, and the zero blocks left out.
+  uint64_t m_transferSize = 0;
+  bool m_skipZeros = false;
+  SparseFile m_sparse;
+  // put in octet mode: DATA payloads are sent straight out of the mapping,
+  // which a server shares between the transfers of the same file.
+  std::shared_ptr<const MappedFile> m_source;
+  // get over io_uring: DATA payloads are written straight from the
+  // (registered) receive buffers; m_currentBuffer is the one being handled.
+  FileWriter m_writer;
+  int m_target = -1;
+  bool m_fixedBuffers = false;
+  size_t m_currentBuffer = 0;
+
+  bool m_serving = false;
+  State m_state = Idle;
+  status m_result = Success;
+  std::string m_errorMessage;
+  Clock::time_point m_deadline;
+  Clock::time_point m_progressAt;
+  // The RFC 2349 timeout asked of the server; a client's when serving is
+  // not known, one second is assumed.
+  std::chrono::seconds m_peerTimeout{1};
+
+  std::vector<Buffer> m_buffers;
+  Buffer m_request;
+  uint16_t m_receivedBlock = 0;
+  uint16_t m_blockSize = m_defaultBlockSize;
+  uint16_t m_windowSize = 1;
+
+  RttEstimator m_rtt;
+  Clock::time_point m_rttStart;
+  bool m_rttPending = false;
+
+  // get: last in-order block and ACK pacing within the window.
+  uint16_t m_lastBlock = 0;
+  uint16_t m_windowCount = 0;
+  bool m_restartRequested = false;
+
+  // put: blocks m_ackedBlock+1 .. m_readBlock stay in the ring until
+  // acknowledged, so a go-back-N restart resends them without file reads.
+  std::vector<Buffer> m_window;
+  std::vector<Header> m_headers;
+  std::vector<size_t> m_packetSizes;
+  uint32_t m_ackedBlock = 0;
+  uint32_t m_nextBlock = 1;
+  uint32_t m_readBlock = 0;
+  uint32_t m_finalBlock = 0;
+  // put: when each block in the ring went out, zero once retransmitted.
+  std::vector<Clock::time_point> m_sentAt;
+  CongestionControl m_congestion;
+  TokenBucket m_pacer;
+  bool m_pacePending = false;
+  Clock::time_point m_paceAt;
+
+  uint64_t m_bytes = 0;
+  uint32_t m_blocks = 0;
+  TransferProgress *m_progress = nullptr;
+  TransferStats m_stats;
+  Clock::time_point m_startTime;
+  int m_packets = 0;
+  int m_losses = 0;
+};
+
+// Outcome of a finished session for asynchronous callers.
+struct TransferResult {
+  TransferSession::status status = TransferSession::Success;
+  // Set when the server answered with an ERROR packet.
+  std::string errorMessage;
+  TransferStats stats;
+
+  static TransferResult from(const TransferSession &session) {
+    TransferResult result;
+    result.status = session.result();
+    result.errorMessage = session.errorMessage();
+    result.stats = session.stats();
+    return result;
+  }
+};
+
+#endif
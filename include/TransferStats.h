@@ -0,0 +1,91 @@
+#ifndef __TransferStats_H__
+#define __TransferStats_H__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// What one transfer did, filled in by the session on its control path (a
+// handful of integer increments per packet) and completed when it ends.
+struct TransferStats {
+  using Duration = std::chrono::microseconds;
+
+  // Upper bounds of the RTT histogram buckets in microseconds, the last
+  // bucket counts everything above.
+  static constexpr size_t m_rttBuckets = 12;
+  static constexpr std::array<uint32_t, m_rttBuckets> m_rttBounds = {
+      100,   250,   500,    1000,   2500,   5000,
+      10000, 25000, 50000, 100000, 250000, 1000000};
+
+  std::string file;
+  std::string direction;
+  int result = 0;
+  // "algorithm:hex" of the local bytes when a digest was asked for.
+  std::string digest;
+
+  uint64_t bytes = 0;
+  uint64_t blocks = 0;
+  uint64_t packets = 0;
+  uint64_t retransmits = 0;
+  uint64_t duplicates = 0;
+  uint64_t timeouts = 0;
+  // get: bytes of all-zero blocks left as holes instead of written.
+  uint64_t sparseBytes = 0;
+  // get: the file size the server announced (RFC 2349 tsize), when it did.
+  bool sizeKnown = false;
+  uint64_t transferSize = 0;
+
+  std::array<uint64_t, m_rttBuckets + 1> rtt{};
+  uint64_t rttSamples = 0;
+  Duration rttSum{0};
+
+  bool firstByte = false;
+  Duration timeToFirstByte{0};
+  Duration duration{0};
+  Duration diskStall{0};
+
+  void recordRtt(Duration sample);
+  std::string toJson() const;
+};
+
+// Aggregates finished transfers and exports them as JSON lines (one per
+// transfer, appended) and as a Prometheus textfile-collector file that is
+// rewritten atomically. Either path may be empty. Thread safe.
+class MetricsExporter {
+ public:
+  MetricsExporter(const std::string &jsonPath,
+                  const std::string &prometheusPath);
+
+  void record(const TransferStats &stats);
+
+ private:
+  struct Totals {
+    uint64_t succeeded = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    uint64_t blocks = 0;
+    uint64_t packets = 0;
+    uint64_t retransmits = 0;
+    uint64_t duplicates = 0;
+    uint64_t timeouts = 0;
+    std::array<uint64_t, TransferStats::m_rttBuckets + 1> rtt{};
+    uint64_t rttSamples = 0;
+    double rttSeconds = 0;
+    uint64_t firstBytes = 0;
+    double firstByteSeconds = 0;
+    double seconds = 0;
+    double diskStallSeconds = 0;
+  };
+
+  bool writePrometheus() const;
+
+  std::string m_jsonPath;
+  std::string m_prometheusPath;
+  std::mutex m_mutex;
+  std::map<std::string, Totals> m_totals;
+};
+
+#endif
@@ -2,35 +2,115 @@
 #define __UDPClient_H__
 
 #include <arpa/inet.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <cstring>
+#include <memory>
 #include <string>
 
+#include <Endpoint.h>
+#include <IoUring.h>
+
+// One datagram of a batched send/receive: up to two iovecs (header and
+// payload) plus the received length and sender. With UDP GRO a
+// received buffer may hold several datagrams of segmentSize bytes each
+// (the last one may be shorter); segmentSize is 0 otherwise.
+struct Datagram {
+  struct iovec iov[2];
+  size_t iovCount;
+  size_t length;
+  Endpoint source;
+  uint16_t segmentSize;
+};
+
 class Socket {
  public:
+  enum Backend { SyscallBackend, UringBackend };
+
   Socket();
   ~Socket();
 
-  int SendTo(const char *buffer, size_t size, const char *host, uint16_t port);
+  // A null destination sends to the connected peer.
+  int SendTo(const char *buffer, size_t size, const Endpoint *to);
+
+  int RecvFrom(void *buffer, size_t size, Endpoint *from = nullptr);
+
+  int SendVecTo(const struct iovec *iov, size_t count, const Endpoint *to);
+
+  int SendBatch(const Datagram *datagrams, size_t count, const Endpoint *to);
+
+  int RecvBatch(Datagram *datagrams, size_t count);
 
-  int RecvFrom(void *buffer, size_t size, char *host = nullptr, uint16_t *port = nullptr);
+  // Once connected, send/recv skip the address entirely and the kernel
+  // drops datagrams from any other source.
+  bool Connect(const Endpoint &peer);
+  // SO_REUSEPORT lets several sockets share the port; the kernel spreads
+  // peers across them by address hash.
+  bool Bind(const Endpoint &local, bool reusePort = false);
+  bool Disconnect();
+  bool IsConnected() const { return m_connected; }
+  // Address the socket is bound to, e.g. the source picked for a peer.
+  bool GetLocalEndpoint(Endpoint &local) const;
+  // Multicast membership on the interface holding `local` (IPv4), or on
+  // the one its scope names (IPv6). Left again when the socket closes.
+  bool JoinGroup(const Endpoint &group, const Endpoint &local);
+
+  // UDP GSO/GRO offload. Both return false when the kernel lacks support;
+  // GSO also switches itself off if a segmented send is ever refused.
+  bool SetSegmentation(bool enable);
+  bool SetReceiveCoalescing(bool enable);
+  bool SegmentationEnabled() const { return m_segmentation; }
+  bool ReceiveCoalescingEnabled() const { return m_coalescing; }
+
+  // Routes datagram I/O through an io_uring instance. Returns false and
+  // stays on plain system calls when the kernel has no io_uring.
+  bool SetBackend(Backend backend);
+  Backend GetBackend() const { return m_ring ? UringBackend : SyscallBackend; }
+  IoUring *Ring() { return m_ring.get(); }
+
+  int WaitForRead(int timeoutMs);
+  bool SetNonBlocking(bool enable);
 
   int GetDescriptor();
-  sockaddr_in GetDestinationAddress();
+  int GetFamily() const { return m_family; }
+  const Endpoint &GetEndpoint() const { return m_endpoint; }
 
  protected:
+  static constexpr size_t m_maxBatch = 64;
+  static constexpr size_t m_maxSegments = 64;
+  static constexpr size_t m_maxSegmentBytes = 65000;
+  static constexpr unsigned m_ringEntries = 256;
+
+  int SendMessages(struct mmsghdr *messages, size_t count);
+  int RecvMessages(struct mmsghdr *messages, size_t count);
+
+  size_t SegmentGroup(const Datagram *datagrams, size_t count) const;
+  int SendSegmented(const Datagram *datagrams, size_t count, const Endpoint *to);
+
   int _sock_desc;
-  sockaddr_in remoteAddrInfo;
+  int m_family = AF_INET;
+  Endpoint m_endpoint;
+  bool m_connected = false;
+  bool m_segmentation = false;
+  bool m_coalescing = false;
+  std::unique_ptr<IoUring> m_ring;
 };
 
-class UDPSocket : public Socket {};
+class UDPSocket : public Socket {
+ public:
+  UDPSocket() {}
+  // A non-blocking socket of the given address family.
+  explicit UDPSocket(int family);
+};
 
 class UDPClient : public UDPSocket {
  public:
   UDPClient() {}
   UDPClient(std::string ip, int port);
-  ~UDPClient();
+  // A socket of the peer's family, e.g. for a server's transfer ID.
+  explicit UDPClient(const Endpoint &peer);
 };
 
 #endif
\ No newline at end of file
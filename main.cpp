@@ -1,8 +1,13 @@
+#include <DirectorySync.h>
 #include <TFTPClient.h>
+#include <TFTPServer.h>
+#include <TransferPool.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <glob.h>
 #include <grp.h>
 #include <pwd.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -14,7 +19,10 @@
 #include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
@@ -25,7 +33,14 @@ extern char *optargi;
 static struct option long_options[] = {
     {"help", no_argument, nullptr, 'h'},
     {"port", required_argument, nullptr, 'p'},
-    {"addr", required_argument, nullptr, 'a'}};
+    {"addr", required_argument, nullptr, 'a'},
+    {"jobs", required_argument, nullptr, 'j'},
+    {"command", required_argument, nullptr, 'c'},
+    {"stats", required_argument, nullptr, 's'},
+    {"metrics", required_argument, nullptr, 'm'},
+    {"serve", required_argument, nullptr, 'S'},
+    {"allow-write", no_argument, nullptr, 'w'},
+    {nullptr, 0, nullptr, 0}};
 
 const string WHITE_SPACE = " \t\r\n";
 
@@ -40,22 +55,79 @@ uint16_t port = 69;
 string remoteaddr = "";
 string mode = "octet";
 string home_dir;
+string script_path;
+size_t jobs = max(1u, thread::hardware_concurrency());
+size_t failed_transfers = 0;
+unique_ptr<TransferPool> pool;
+string stats_path;
+string metrics_path;
+string serve_root;
+bool allow_write = false;
+unique_ptr<MetricsExporter> metrics;
 
 vector<string> cmd_history;
+const string usage(
+    "Usage:   tftp [--addr | -a] addr [--port | -p] port [--jobs | -j] "
+    "workers [--command | -c] script|-\n         [--stats | -s] jsonl "
+    "[--metrics | -m] prom\n"
+    "         tftp [--serve | -S] root [[--addr | -a] bind] [--port | -p] "
+    "port [--jobs | -j] workers\n         [--allow-write | -w]\n  \n");
 const string helpinfo(
     "\tUsage:\n"
     "\t\tls \n"
     "\t\tpwd \n"
     "\t\tcd [~|dir] \n"
     "\t\tmode [mode(default octet)] \n"
-    "\t\tput filename\n"
-    "\t\tget filename\n"
+    "\t\tblksize [size(8-65464, default 1468)] \n"
+    "\t\twindowsize [blocks(1-65535, default 8)] \n"
+    "\t\toffload [on|off(default off)] \n"
+    "\t\tsparse [on|off(default on)] \n"
+    "\t\trate [bits/s[K|M|G]|off(default off)] \n"
+    "\t\tbackend [uring|syscall(default syscall)] \n"
+    "\t\twriter [inline|behind|direct(default behind)] \n"
+    "\t\tdigest [crc32c|sha256|off(default off)] \n"
+    "\t\tput local|- [remote]\n"
+    "\t\tget remote [local|-] [--verify digest|manifest]\n"
+    "\t\tmcget remote [local]\n"
+    "\t\tmput pattern... \n"
+    "\t\tmget filename... \n"
+    "\t\tsync manifest localdir \n"
+    "\t\tjobs [workers] \n"
     "\t\thistory \n"
     "\t\tclear \n"
     "\t\thelp \n"
     "\t\t? \n"
     "\t\tquit \n");
 
+// Decimal SI suffixes, as rates are quoted: 200M is 200 000 000 bits/s.
+bool parse_rate(const string &text, uint64_t &rate) {
+  char *end = nullptr;
+  const double value = strtod(text.c_str(), &end);
+  if (end == text.c_str() || value <= 0) return false;
+  double scale = 1;
+  switch (*end) {
+    case 'G':
+    case 'g':
+      scale = 1e9;
+      break;
+    case 'M':
+    case 'm':
+      scale = 1e6;
+      break;
+    case 'K':
+    case 'k':
+      scale = 1e3;
+      break;
+    case '\0':
+      break;
+    default:
+      return false;
+  }
+  if (*end != '\0' && end[1] != '\0') return false;
+  rate = static_cast<uint64_t>(value * scale);
+  return rate > 0;
+}
+
 void panic(string hint, bool exit_ = false, int exit_code = 0) {
   if (SHOW_PANIC) cerr << "[!ExpShell panic]: " << hint << endl;
   if (exit_) exit(exit_code);
@@ -159,11 +231,375 @@ int process_builtin_command(string line) {
     return 1;
   }
 
-  if (line == "quit") {
-    cout << "Bye~~~!" << endl;
-    exit(0);
+  return 0;
+}
+
+vector<string> expand_globs(const vector<string> &patterns) {
+  vector<string> files;
+  for (const string &pattern : patterns) {
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) != 0) {
+      cout << "no match: " << pattern << endl;
+      globfree(&matches);
+      continue;
+    }
+    for (size_t i = 0; i < matches.gl_pathc; i++)
+      files.push_back(matches.gl_pathv[i]);
+    globfree(&matches);
+  }
+  return files;
+}
+
+void record_stats(const TransferStats &stats) {
+  if (metrics) metrics->record(stats);
+}
+
+// Runs on the pool's workers.
+void report_transfer(const TransferPool::Task &task, TFTPClient::status st,
+                     const TransferStats &stats) {
+  static mutex output;
+  lock_guard<mutex> lock(output);
+  record_stats(stats);
+  const uint64_t bytes = stats.bytes;
+  const char *command =
+      task.direction == TransferSession::Get ? "get" : "put";
+  if (st == TFTPClient::status::Success) {
+    cout << command << " " << task.fileName << ": " << bytes << " bytes"
+         << endl;
+  } else {
+    cout << command << " " << task.fileName << ": "
+         << TFTPClient::errorDescription(st);
+  }
+}
+
+// The workers log into the shell client's file.
+TransferPool &transfer_pool(TFTPClient &remote) {
+  if (!pool || pool->workers() != jobs)
+    pool.reset(new TransferPool(remoteaddr, port, jobs, report_transfer,
+                                remote.log()));
+  return *pool;
+}
+
+void queue_transfer(TransferSession::Direction direction, const string &file,
+                    TFTPClient &remote) {
+  transfer_pool(remote).submit({direction, file, remote.options(), file});
+}
+
+void flush_transfers() {
+  if (!pool) return;
+  TransferPool::Summary summary = pool->wait();
+  if (summary.succeeded + summary.failed == 0) return;
+  failed_transfers += summary.failed;
+  double kbs = summary.seconds > 0 ? summary.bytes / summary.seconds / 1000.0
+                                   : 0.0;
+  printf("\n%zu files transferred, %zu failed. %llu bytes in %.2lf s "
+         "(%.2lf kb/s, %zu workers).\n",
+         summary.succeeded, summary.failed,
+         static_cast<unsigned long long>(summary.bytes), summary.seconds, kbs,
+         pool->workers());
+}
+
+// Fetches what changed of the files `manifest` names into `directory`.
+void sync_directory(const string &manifest, const string &directory,
+                    TFTPClient &remote) {
+  DirectorySync sync(
+      remoteaddr, port, jobs, remote.options(),
+      [](const string &message) { cout << message << flush; },
+      [](const TransferPool::Task &, TFTPClient::status,
+         const TransferStats &stats) { record_stats(stats); },
+      remote.log());
+  const DirectorySync::status st = sync.run(manifest, directory);
+  if (st == DirectorySync::ManifestError) {
+    ++failed_transfers;
+    cout << "Can't read manifest " << manifest << "." << endl;
+    return;
+  }
+  if (st == DirectorySync::DirectoryError) {
+    ++failed_transfers;
+    cout << "Can't update " << directory << "." << endl;
+  }
+  const DirectorySync::Summary &summary = sync.summary();
+  failed_transfers += summary.failed;
+  printf("\n%zu files: %zu unchanged, %zu transferred, %zu failed. %llu "
+         "bytes in %.2lf s (%zu workers).\n",
+         summary.files, summary.unchanged, summary.transferred,
+         summary.failed, static_cast<unsigned long long>(summary.bytes),
+         summary.seconds, jobs);
+}
+
+// "--verify X": X is a sha256sum-style manifest when such a file exists,
+// otherwise the digest itself.
+bool parse_verify(const string &value, const string &remoteFile,
+                  Digest::Algorithm &algorithm, string &digest) {
+  struct stat info;
+  if (stat(value.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+    if (Digest::fromManifest(value, remoteFile, algorithm, digest))
+      return true;
+    cout << "No digest for " << remoteFile << " in " << value << endl;
+    return false;
+  }
+  if (Digest::parse(value, algorithm, digest)) return true;
+  cout << "Invalid digest: " << value << endl;
+  return false;
+}
+
+// get remote [local] [--verify X], put local [remote]; "-" is stdout or
+// stdin, and then every message goes to stderr.
+void run_transfer(vector<string> args, TFTPClient &remote) {
+  const bool isGet = args[0] == "get";
+  string verify;
+  auto flag = find(args.begin(), args.end(), "--verify");
+  if (!isGet && flag != args.end()) {
+    // Otherwise it would be taken for the remote name.
+    ++failed_transfers;
+    cout << "--verify only applies to get." << endl;
+    return;
+  }
+  if (flag != args.end()) {
+    if (flag + 1 == args.end()) {
+      cout << "Missing digest for --verify." << endl;
+      return;
+    }
+    verify = *(flag + 1);
+    args.erase(flag, flag + 2);
+  }
+  if (args.size() < 2) {
+    cout << "Missing remote file name." << endl;
+    return;
+  }
+  const string &first = args[1];
+  const string second = args.size() > 2 ? args[2] : first;
+  const string &remoteFile = isGet ? first : second;
+  const string &localFile = isGet ? second : first;
+  const bool piped = localFile == "-";
+  ostream &out = piped ? cerr : cout;
+  if (remoteFile == "-") {
+    out << "Missing remote file name." << endl;
+    return;
   }
 
+  const Digest::Algorithm configured = remote.options().digest;
+  if (!verify.empty()) {
+    Digest::Algorithm algorithm;
+    string digest;
+    if (!parse_verify(verify, remoteFile, algorithm, digest)) {
+      ++failed_transfers;
+      return;
+    }
+    remote.setDigest(algorithm, digest);
+  }
+
+  if (piped) remote.setOutput([](const string &message) {
+    cerr << message << flush;
+  });
+  TFTPClient::status st;
+  if (piped && isGet) {
+    cout << flush;
+    st = remote.get(remoteFile, make_shared<FdSink>(STDOUT_FILENO));
+  } else if (piped) {
+    st = remote.put(make_shared<FdSource>(STDIN_FILENO), remoteFile);
+  } else {
+    st = isGet ? remote.get(remoteFile, localFile)
+               : remote.put(localFile, remoteFile);
+  }
+  if (piped) remote.setOutput([](const string &message) {
+    cout << message << flush;
+  });
+  if (!verify.empty()) remote.setDigest(configured);
+
+  record_stats(remote.lastStats());
+  if (st != TFTPClient::status::Success) {
+    ++failed_transfers;
+    out << remote.errorDescription(st) << endl;
+    remote.writeLog(remote.errorDescription(st));
+  }
+}
+
+void process_line(string line, TFTPClient &remote, bool batch) {
+  if (line.empty() || line[0] == '#') return;
+  cmd_history.push_back(line);
+  if (process_builtin_command(line) > 0) return;
+
+  vector<string> args = string_split(line, WHITE_SPACE);
+  transform(args[0].begin(), args[0].end(), args[0].begin(),
+            [](unsigned char c) { return tolower(c); });
+  TFTPClient::status st;
+  if (args.size() == 1) {
+    cout << "command not found: " << args[0] << endl;
+  } else if ((args[0] == "get" || args[0] == "put") && batch &&
+             args.size() == 2 && args[1] != "-") {
+    queue_transfer(args[0] == "get" ? TransferSession::Get
+                                    : TransferSession::Put,
+                   args[1], remote);
+  } else if (args[0] == "get" || args[0] == "put") {
+    // Renames and pipes run in order with the queued transfers.
+    if (batch) flush_transfers();
+    run_transfer(args, remote);
+  } else if (args[0] == "mcget") {
+    // RFC 2090 multicast get, shared with every other client of the file.
+    if (batch) flush_transfers();
+    const string &localFile = args.size() > 2 ? args[2] : args[1];
+    st = remote.getMulticast(args[1], localFile);
+    record_stats(remote.lastStats());
+    if (st != TFTPClient::status::Success) {
+      ++failed_transfers;
+      cout << remote.errorDescription(st) << endl;
+      remote.writeLog(remote.errorDescription(st));
+    }
+  } else if (args[0] == "mget" || args[0] == "mput") {
+    // TFTP has no directory listing, so only local names can be globbed.
+    vector<string> names(args.begin() + 1, args.end());
+    if (args[0] == "mput") names = expand_globs(names);
+    for (const string &name : names)
+      queue_transfer(args[0] == "mget" ? TransferSession::Get
+                                       : TransferSession::Put,
+                     name, remote);
+    if (!batch) flush_transfers();
+  } else if (args[0] == "sync") {
+    if (args.size() < 3) {
+      cout << "Usage: sync manifest localdir" << endl;
+      return;
+    }
+    if (batch) flush_transfers();
+    sync_directory(args[1], args[2], remote);
+  } else if (args[0] == "jobs") {
+    int workers = atoi(args[1].c_str());
+    if (workers <= 0) {
+      cout << "Invalid worker count: " << args[1] << endl;
+      return;
+    }
+    flush_transfers();
+    jobs = workers;
+    cout << "Use " << jobs << " workers." << endl;
+  } else if (args[0] == "mode") {
+    cout << "Currently in " << mode << " mode." << endl;
+    transform(args[1].begin(), args[1].end(), args[1].begin(),
+              [](unsigned char c) { return tolower(c); });
+    mode = args[1];
+    remote.changeMode(mode);
+    cout << "Change the mode to " << mode << "." << endl;
+  } else if (args[0] == "blksize") {
+    int blockSize = atoi(args[1].c_str());
+    if (blockSize <= 0 || blockSize > 65535 ||
+        !remote.setBlockSize(static_cast<uint16_t>(blockSize))) {
+      cout << "Invalid block size: " << args[1] << endl;
+      return;
+    }
+    cout << "Request block size " << blockSize << "." << endl;
+  } else if (args[0] == "windowsize") {
+    int windowSize = atoi(args[1].c_str());
+    if (windowSize <= 0 || windowSize > 65535 ||
+        !remote.setWindowSize(static_cast<uint16_t>(windowSize))) {
+      cout << "Invalid window size: " << args[1] << endl;
+      return;
+    }
+    cout << "Request window size " << windowSize << "." << endl;
+  } else if (args[0] == "offload") {
+    const bool offload = args[1] == "on";
+    remote.setOffload(offload);
+    cout << "UDP segmentation offload " << (offload ? "on" : "off") << "."
+         << endl;
+  } else if (args[0] == "sparse") {
+    const bool sparse = args[1] != "off";
+    remote.setSparse(sparse);
+    cout << "Zero blocks " << (sparse ? "left as holes" : "written") << "."
+         << endl;
+  } else if (args[0] == "rate") {
+    uint64_t rate = 0;
+    if (args[1] != "off" && !parse_rate(args[1], rate)) {
+      cout << "Invalid rate: " << args[1] << endl;
+      return;
+    }
+    remote.setRate(rate);
+    if (rate == 0) {
+      cout << "Upload rate unlimited." << endl;
+    } else {
+      cout << "Upload rate capped at " << args[1] << "bit/s." << endl;
+    }
+  } else if (args[0] == "digest") {
+    Digest::Algorithm algorithm = Digest::NoDigest;
+    if (args[1] != "off" && !Digest::parseAlgorithm(args[1], algorithm)) {
+      cout << "Invalid digest: " << args[1] << endl;
+      return;
+    }
+    remote.setDigest(algorithm);
+    cout << "Digest " << Digest::name(algorithm) << "." << endl;
+  } else if (args[0] == "backend") {
+    const bool uring = args[1] == "uring";
+    if (!remote.setBackend(uring ? Socket::UringBackend
+                                 : Socket::SyscallBackend)) {
+      cout << "io_uring is not available, staying on system calls." << endl;
+      return;
+    }
+    cout << "I/O backend " << (uring ? "io_uring" : "system calls") << "."
+         << endl;
+  } else if (args[0] == "writer") {
+    if (args[1] != "inline" && args[1] != "behind" && args[1] != "direct") {
+      cout << "Invalid writer: " << args[1] << endl;
+      return;
+    }
+    remote.setWriteBehind(args[1] != "inline", args[1] == "direct");
+    cout << "File writes " << args[1] << "." << endl;
+  } else {
+    cout << helpinfo << endl;
+  }
+}
+
+int run_script(TFTPClient &remote) {
+  ifstream script;
+  istream *in = &cin;
+  if (script_path != "-") {
+    script.open(script_path.c_str());
+    if (!script) {
+      panic("can't open script " + script_path);
+      return 1;
+    }
+    in = &script;
+  }
+  string line;
+  while (getline(*in, line)) {
+    line = trim(line);
+    if (line == "quit") break;
+    process_line(line, remote, true);
+  }
+  flush_transfers();
+  pool.reset();
+  return failed_transfers == 0 ? 0 : 1;
+}
+
+int run_server() {
+  ServerOptions options;
+  options.root = serve_root;
+  if (!remoteaddr.empty()) options.address = remoteaddr;
+  options.port = port;
+  options.workers = jobs;
+  options.allowWrite = allow_write;
+
+  // Workers inherit the mask, so only this thread sees SIGINT/SIGTERM.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  TFTPServer server(options);
+  if (!server.start()) {
+    panic("can't listen on " + options.address + " port " + to_string(port));
+    return 1;
+  }
+  cout << "Serving " << options.root
+       << (options.allowWrite ? "" : " read-only") << " on "
+       << options.address << " port " << port << " with " << server.workers()
+       << " workers." << endl;
+  int signal = 0;
+  sigwait(&signals, &signal);
+  server.stop();
+
+  const TFTPServer::Totals totals = server.totals();
+  cout << "\n"
+       << totals.transfers << " transfers (" << totals.failed << " failed), "
+       << totals.bytes << " bytes, file cache " << totals.cacheHits
+       << " hits / " << totals.cacheMisses << " misses." << endl;
   return 0;
 }
 
@@ -173,13 +609,14 @@ int main(int argc, char *argv[]) {
          << endl;
     exit(0);
   }
-  system("clear");
   int index = 0;
   int c = 0;
-  while (EOF != (c = getopt_long(argc, argv, "hvn:", long_options, &index))) {
+  while (EOF !=
+         (c = getopt_long(argc, argv, "ha:p:j:c:s:m:S:w", long_options,
+                          &index))) {
     switch (c) {
       case 'h':
-        cout << "Usage:   tftp [--addr | -a] addr [--port | -p] port\n  \n";
+        cout << usage;
         break;
       case 'a':
         remoteaddr = optarg;
@@ -187,69 +624,55 @@ int main(int argc, char *argv[]) {
       case 'p':
         port = stoi(optarg);
         break;
+      case 'j':
+        jobs = max(1, atoi(optarg));
+        break;
+      case 'c':
+        script_path = optarg;
+        break;
+      case 's':
+        stats_path = optarg;
+        break;
+      case 'm':
+        metrics_path = optarg;
+        break;
+      case 'S':
+        serve_root = optarg;
+        break;
+      case 'w':
+        allow_write = true;
+        break;
       case '?':
-        cout << "unknow option: " << optopt << "\n\n"
-             << "Usage:   tftp [--addr | -a] addr [--port | -p] port\n  \n";
+        cout << "unknow option: " << optopt << "\n\n" << usage;
         exit(0);
         break;
       default:
         break;
     }
   }
+  if (!serve_root.empty()) return run_server();
   if (remoteaddr.length() == 0) {
-    cout << "Invalid parameters!\n\n"
-         << "Usage:   tftp [--addr | -a] addr [--port | -p] port\n  \n";
+    cout << "Invalid parameters!\n\n" << usage;
     exit(0);
   }
 
+  if (!stats_path.empty() || !metrics_path.empty())
+    metrics.reset(new MetricsExporter(stats_path, metrics_path));
   TFTPClient remote(remoteaddr, port, mode);
-  string line;
-  int wait_status;
+  remote.setOutput([](const string &message) { cout << message << flush; });
+  if (!script_path.empty()) return run_script(remote);
+
+  system("clear");
   while (true) {
     show_command_prompt();
-    line = trim(read_line());
-    cmd_history.push_back(line);
-    if (process_builtin_command(line) > 0) continue;
-
-    vector<string> args = string_split(line, WHITE_SPACE);
-    transform(args[0].begin(), args[0].end(), args[0].begin(),
-              [](unsigned char c) { return tolower(c); });
-    TFTPClient::status st;
-    if (args.size() == 0)
-      continue;
-    else if (args.size() == 1) {
-      cout << "command not found: " << args[0] << endl;
-      continue;
-    } else {
-      if (args[0] == "get") {
-        st = remote.get(args[1]);
-        if (st != TFTPClient::status::Success) {
-          cout << remote.errorDescription(st) << endl;
-          remote.writeLog(remote.errorDescription(st));
-          continue;
-        }
-      } else if (args[0] == "put") {
-        st = remote.put(args[1]);
-        if (st != TFTPClient::status::Success) {
-          cout << remote.errorDescription(st) << endl;
-          remote.writeLog(remote.errorDescription(st));
-        }
-        continue;
-      } else if (args[0] == "mode") {
-        cout << "Currently in " << mode << " mode." << endl;
-        transform(args[1].begin(), args[1].end(), args[1].begin(),
-                  [](unsigned char c) { return tolower(c); });
-        mode = args[1];
-        remote.changeMode(mode);
-        cout << "Change the mode to " << mode << "." << endl;
-        continue;
-      } else {
-        cout << helpinfo << endl;
-        continue;
-      }
-    }
-    wait(&wait_status);
-    check_wait_status(wait_status);
+    string line = read_line();
+    if (!cin) line = "quit";
+    line = trim(line);
+    // Leave through main so the log and the workers wind down cleanly.
+    if (line == "quit") break;
+    process_line(line, remote, false);
   }
+  pool.reset();
+  cout << "Bye~~~!" << endl;
   return 0;
 }
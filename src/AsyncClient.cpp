@@ -0,0 +1,81 @@
+#include <AsyncClient.h>
+
+#include <memory>
+#include <vector>
+
+AsyncClient::AsyncClient(const std::string &ip, uint16_t port,
+                         const TransferOptions &options,
+                         TransferEngine::SocketFactory socketFactory)
+    : m_remoteAddress(ip), m_port(port), m_options(options) {
+  m_engine.setSocketFactory(std::move(socketFactory));
+  m_thread = std::thread(&AsyncClient::run, this);
+}
+
+AsyncClient::~AsyncClient() {
+  m_engine.post([this] {
+    std::vector<TransferEngine::Id> ids;
+    for (const auto &running : m_running) ids.push_back(running.second);
+    for (const TransferEngine::Id id : ids) {
+      m_engine.cancel(id, TransferSession::Cancelled);
+    }
+    m_stopping = true;
+  });
+  m_thread.join();
+}
+
+AsyncClient::Handle AsyncClient::start(TransferSession::Direction direction,
+                                       const std::string &remoteFile,
+                                       const std::string &localFile,
+                                       const TransferOptions &options,
+                                       Callback done) {
+  const Handle handle = m_nextHandle++;
+  m_engine.post([=, this] {
+    auto finished = std::make_shared<bool>(false);
+    const TransferEngine::Id id = m_engine.submit(
+        direction, m_remoteAddress, m_port, remoteFile, localFile, options,
+        [this, handle, done, finished](TransferEngine::Id,
+                                       const TransferSession &session) {
+          *finished = true;
+          m_running.erase(handle);
+          if (done) done(handle, TransferResult::from(session));
+        });
+    // submit() completes transfers that fail right away before returning.
+    if (!*finished) m_running[handle] = id;
+  });
+  return handle;
+}
+
+void AsyncClient::cancel(Handle handle) {
+  m_engine.post([this, handle] {
+    const auto found = m_running.find(handle);
+    if (found != m_running.end()) {
+      m_engine.cancel(found->second, TransferSession::Cancelled);
+    }
+  });
+}
+
+std::future<TransferResult> AsyncClient::get(const std::string &remoteFile,
+                                             const std::string &localFile) {
+  return startFuture(TransferSession::Get, remoteFile, localFile);
+}
+
+std::future<TransferResult> AsyncClient::put(const std::string &localFile,
+                                             const std::string &remoteFile) {
+  return startFuture(TransferSession::Put, remoteFile, localFile);
+}
+
+std::future<TransferResult> AsyncClient::startFuture(
+    TransferSession::Direction direction, const std::string &remoteFile,
+    const std::string &localFile) {
+  auto promise = std::make_shared<std::promise<TransferResult>>();
+  std::future<TransferResult> result = promise->get_future();
+  start(direction, remoteFile, localFile, m_options,
+        [promise](Handle, const TransferResult &finished) {
+          promise->set_value(finished);
+        });
+  return result;
+}
+
+void AsyncClient::run() {
+  while (!m_stopping) m_engine.poll(1000);
+}
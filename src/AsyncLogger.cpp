@@ -0,0 +1,119 @@
+#include <AsyncLogger.h>
+
+#include <cstring>
+#include <ctime>
+
+AsyncLogger::AsyncLogger() : m_ring(new Slot[m_slots]) {
+  for (size_t i = 0; i < m_slots; ++i) {
+    m_ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+AsyncLogger::~AsyncLogger() { close(); }
+
+bool AsyncLogger::open(const std::string &path) {
+  close();
+  m_file = std::fopen(path.c_str(), "a");
+  if (m_file == nullptr) return false;
+  m_stopping.store(false, std::memory_order_relaxed);
+  m_thread = std::thread(&AsyncLogger::run, this);
+  return true;
+}
+
+void AsyncLogger::close() {
+  if (m_file == nullptr) return;
+  m_stopping.store(true, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  wake();
+  if (m_thread.joinable()) m_thread.join();
+  std::fclose(m_file);
+  m_file = nullptr;
+}
+
+bool AsyncLogger::log(const char *message, size_t size) {
+  if (m_file == nullptr) return false;
+  size_t position = m_enqueue.load(std::memory_order_relaxed);
+  Slot *slot;
+  while (true) {
+    slot = &m_ring[position % m_slots];
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t distance = static_cast<intptr_t>(sequence) -
+                              static_cast<intptr_t>(position);
+    if (distance == 0) {
+      if (m_enqueue.compare_exchange_weak(position, position + 1,
+                                          std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (distance < 0) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      position = m_enqueue.load(std::memory_order_relaxed);
+    }
+  }
+  Record &record = slot->record;
+  record.time = Clock::now();
+  if (size <= m_messageSize) {
+    std::memcpy(record.text, message, size);
+  } else {
+    const size_t marker = std::strlen(m_truncated);
+    size = m_messageSize;
+    std::memcpy(record.text, message, size - marker);
+    std::memcpy(record.text + size - marker, m_truncated, marker);
+  }
+  record.length = static_cast<uint16_t>(size);
+  slot->sequence.store(position + 1, std::memory_order_release);
+  // Pairs with the fence in run(): either the drain thread sees this
+  // message before sleeping, or this sees it asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed)) wake();
+  return true;
+}
+
+void AsyncLogger::wake() {
+  if (m_sleeping.exchange(false, std::memory_order_relaxed)) {
+    m_sleeping.notify_one();
+  }
+}
+
+void AsyncLogger::run() {
+  while (true) {
+    // Read the flag first so nothing logged before close() is lost.
+    const bool stopping = m_stopping.load(std::memory_order_acquire);
+    size_t drained = 0;
+    while (pending()) {
+      Slot &slot = m_ring[m_dequeue % m_slots];
+      write(slot.record);
+      slot.sequence.store(m_dequeue + m_slots, std::memory_order_release);
+      ++m_dequeue;
+      ++drained;
+    }
+    const uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reportedDrops) {
+      std::fprintf(m_file, "(%llu log messages dropped)\n",
+                   static_cast<unsigned long long>(dropped - m_reportedDrops));
+      m_reportedDrops = dropped;
+      ++drained;
+    }
+    if (drained > 0) std::fflush(m_file);
+    if (stopping) return;
+    if (drained > 0) continue;
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!pending() && !m_stopping.load(std::memory_order_relaxed)) {
+      m_sleeping.wait(true, std::memory_order_relaxed);
+    }
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+void AsyncLogger::write(const Record &record) {
+  const std::time_t seconds = Clock::to_time_t(record.time);
+  if (seconds != m_stampTime) {
+    struct tm local;
+    ::localtime_r(&seconds, &local);
+    std::strftime(m_stamp, sizeof(m_stamp), "%Y-%b-%d-%H:%M:%S", &local);
+    m_stampTime = seconds;
+  }
+  std::fprintf(m_file, "%s:\t%.*s\n", m_stamp, record.length, record.text);
+}
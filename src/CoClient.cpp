@@ -0,0 +1,15 @@
+#include <CoClient.h>
+
+void CoClient::Transfer::await_suspend(std::coroutine_handle<> awaiting) {
+  Executor &executor = m_client.m_executor;
+  // Resume through the ready queue, never from inside the engine: the
+  // completion may even run before submit() returns.
+  executor.engine().submit(
+      m_direction, m_client.m_remoteAddress, m_client.m_port, m_remoteFile,
+      m_localFile, m_client.m_options,
+      [this, &executor, awaiting](TransferEngine::Id,
+                                  const TransferSession &session) {
+        m_result = TransferResult::from(session);
+        executor.schedule(awaiting);
+      });
+}
@@ -0,0 +1,65 @@
+#include <CongestionControl.h>
+
+#include <algorithm>
+
+void CongestionControl::onAck(uint32_t blocks, Duration rtt,
+                              Clock::time_point now) {
+  if (rtt > Duration::zero()) sampleRtt(rtt, now);
+  if (slowStart()) {
+    m_window += blocks;
+  } else {
+    m_window += blocks / m_window;
+  }
+  m_window = std::min(m_window, m_maxWindow);
+}
+
+void CongestionControl::sampleRtt(Duration rtt, Clock::time_point now) {
+  const RttSample sample{now, rtt};
+  if (m_rtt[0].rtt == Duration::zero() || rtt <= m_rtt[0].rtt ||
+      now - m_rtt[2].time > m_rttWindow) {
+    m_rtt[0] = m_rtt[1] = m_rtt[2] = sample;
+    return;
+  }
+  if (rtt <= m_rtt[1].rtt) {
+    m_rtt[1] = m_rtt[2] = sample;
+  } else if (rtt <= m_rtt[2].rtt) {
+    m_rtt[2] = sample;
+  }
+  const Clock::duration age = now - m_rtt[0].time;
+  if (age > m_rttWindow) {
+    // The best sample expired: the next best takes over.
+    m_rtt[0] = m_rtt[1];
+    m_rtt[1] = m_rtt[2];
+    m_rtt[2] = sample;
+    if (now - m_rtt[0].time > m_rttWindow) {
+      m_rtt[0] = m_rtt[1];
+      m_rtt[1] = m_rtt[2];
+    }
+  } else if (m_rtt[1].time == m_rtt[0].time && age > m_rttWindow / 4) {
+    // Nothing better for a quarter window: keep a fresher second best.
+    m_rtt[1] = m_rtt[2] = sample;
+  } else if (m_rtt[2].time == m_rtt[1].time && age > m_rttWindow / 2) {
+    m_rtt[2] = sample;
+  }
+}
+
+void CongestionControl::onCongestion(uint32_t acked, uint32_t sent) {
+  if (m_recovering && acked < m_recover) return;
+  m_recovering = true;
+  m_recover = sent;
+  m_threshold = std::max(m_window / 2, m_minWindow);
+  m_window = m_threshold;
+}
+
+void CongestionControl::onTimeout(uint32_t sent) {
+  m_recovering = true;
+  m_recover = sent;
+  m_threshold = std::max(m_window / 2, m_minWindow);
+  m_window = m_minWindow;
+}
+
+uint64_t CongestionControl::rate(size_t packetSize) const {
+  if (pathRtt() == Duration::zero()) return 0;
+  const double seconds = std::chrono::duration<double>(pathRtt()).count();
+  return static_cast<uint64_t>(m_window * packetSize / seconds);
+}
@@ -0,0 +1,55 @@
+#include <DataStream.h>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+// Waits out EAGAIN on descriptors someone else made non-blocking.
+static bool waitFor(int fd, short events) {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = events;
+  pfd.revents = 0;
+  return ::poll(&pfd, 1, -1) >= 0 || errno == EINTR;
+}
+
+bool FdSink::write(const char *data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = ::write(m_fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(m_fd, POLLOUT))
+        continue;
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+std::streamsize FdSource::read(char *data, size_t size) {
+  size_t filled = 0;
+  while (filled < size) {
+    const ssize_t got = ::read(m_fd, data + filled, size - filled);
+    if (got == 0) break;
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(m_fd, POLLIN))
+        continue;
+      return -1;
+    }
+    filled += static_cast<size_t>(got);
+  }
+  return static_cast<std::streamsize>(filled);
+}
+
+std::streamsize MemorySource::read(char *data, size_t size) {
+  const size_t copied = std::min(size, m_data.size() - m_offset);
+  std::memcpy(data, m_data.data() + m_offset, copied);
+  m_offset += copied;
+  return static_cast<std::streamsize>(copied);
+}
@@ -0,0 +1,371 @@
+#include <Digest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define DIGEST_X86 1
+#endif
+
+namespace {
+
+constexpr uint32_t m_crcPolynomial = 0x82f63b78;  // reflected 0x1edc6f41
+
+struct CrcTable {
+  uint32_t entries[256];
+  constexpr CrcTable() : entries() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = crc & 1 ? (crc >> 1) ^ m_crcPolynomial : crc >> 1;
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+constexpr CrcTable m_crcTable;
+
+uint32_t crcScalar(uint32_t crc, const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    crc = m_crcTable.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+constexpr uint32_t m_sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline uint32_t rotr(uint32_t value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+void sha256Scalar(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  uint32_t w[64];
+  for (; blocks > 0; --blocks, data += 64) {
+    for (int i = 0; i < 16; ++i) {
+      w[i] = (uint32_t(data[4 * i]) << 24) | (uint32_t(data[4 * i + 1]) << 16) |
+             (uint32_t(data[4 * i + 2]) << 8) | uint32_t(data[4 * i + 3]);
+    }
+    for (int i = 16; i < 64; ++i) {
+      const uint32_t s0 =
+          rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const uint32_t s1 =
+          rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+      const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+      const uint32_t choice = (e & f) ^ (~e & g);
+      const uint32_t t1 = h + s1 + choice + m_sha256K[i] + w[i];
+      const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+      const uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+      const uint32_t t2 = s0 + majority;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#if defined(DIGEST_X86)
+__attribute__((target("sse4.2"))) uint32_t crcHardware(uint32_t crc,
+                                                       const uint8_t *data,
+                                                       size_t size) {
+#if defined(__x86_64__)
+  uint64_t wide = crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    wide = _mm_crc32_u64(wide, word);
+  }
+  crc = static_cast<uint32_t>(wide);
+#endif
+  for (; size > 0; --size, ++data) crc = _mm_crc32_u8(crc, *data);
+  return crc;
+}
+
+// Four rounds per step on the ABEF/CDGH state layout the SHA extensions
+// use; the message schedule rolls through four registers.
+__attribute__((target("sha,sse4.1"))) void sha256ShaNi(uint32_t state[8],
+                                                       const uint8_t *data,
+                                                       size_t blocks) {
+  const __m128i byteSwap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+  __m128i swapped = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0])), 0xb1);
+  __m128i cdgh = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4])), 0x1b);
+  __m128i abef = _mm_alignr_epi8(swapped, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, swapped, 0xf0);
+
+  for (; blocks > 0; --blocks, data += 64) {
+    const __m128i abefSaved = abef;
+    const __m128i cdghSaved = cdgh;
+    __m128i w[4];
+#pragma GCC unroll 16
+    for (int step = 0; step < 16; ++step) {
+      __m128i &current = w[step % 4];
+      if (step < 4) {
+        current = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data) + step),
+            byteSwap);
+      } else {
+        const __m128i &next = w[(step + 1) % 4];
+        const __m128i &previous = w[(step + 3) % 4];
+        const __m128i &older = w[(step + 2) % 4];
+        current = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(current, next),
+                          _mm_alignr_epi8(previous, older, 4)),
+            previous);
+      }
+      __m128i message = _mm_add_epi32(
+          current,
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(m_sha256K) +
+                          step));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+      message = _mm_shuffle_epi32(message, 0x0e);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+    }
+    abef = _mm_add_epi32(abef, abefSaved);
+    cdgh = _mm_add_epi32(cdgh, cdghSaved);
+  }
+
+  swapped = _mm_shuffle_epi32(abef, 0x1b);
+  cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+  abef = _mm_blend_epi16(swapped, cdgh, 0xf0);
+  cdgh = _mm_alignr_epi8(cdgh, swapped, 8);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), abef);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), cdgh);
+}
+
+bool hasShaExtensions() {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+  return (ebx & (1u << 29)) != 0 && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+using CrcFunction = uint32_t (*)(uint32_t, const uint8_t *, size_t);
+using ShaFunction = void (*)(uint32_t *, const uint8_t *, size_t);
+
+CrcFunction crcFunction() {
+#if defined(DIGEST_X86)
+  static const CrcFunction function =
+      __builtin_cpu_supports("sse4.2") ? crcHardware : crcScalar;
+  return function;
+#else
+  return crcScalar;
+#endif
+}
+
+ShaFunction shaFunction() {
+#if defined(DIGEST_X86)
+  static const ShaFunction function =
+      hasShaExtensions() ? sha256ShaNi : sha256Scalar;
+  return function;
+#else
+  return sha256Scalar;
+#endif
+}
+
+std::string toHex(const uint8_t *data, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(2 * size, '0');
+  for (size_t i = 0; i < size; ++i) {
+    hex[2 * i] = digits[data[i] >> 4];
+    hex[2 * i + 1] = digits[data[i] & 0xf];
+  }
+  return hex;
+}
+
+std::string toLower(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+std::string baseName(const std::string &path) {
+  const size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+void Crc32c::update(const void *data, size_t size) {
+  m_crc = crcFunction()(m_crc, static_cast<const uint8_t *>(data), size);
+}
+
+void Sha256::reset() {
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                      0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                      0x1f83d9ab, 0x5be0cd19};
+  std::memcpy(m_state, initial, sizeof(m_state));
+  m_buffered = 0;
+  m_length = 0;
+}
+
+void Sha256::update(const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  m_length += size;
+  if (m_buffered > 0) {
+    const size_t take = std::min(size, sizeof(m_buffer) - m_buffered);
+    std::memcpy(m_buffer + m_buffered, bytes, take);
+    m_buffered += take;
+    bytes += take;
+    size -= take;
+    if (m_buffered < sizeof(m_buffer)) return;
+    shaFunction()(m_state, m_buffer, 1);
+    m_buffered = 0;
+  }
+  // Whole blocks straight from the caller's buffer.
+  const size_t blocks = size / 64;
+  if (blocks > 0) shaFunction()(m_state, bytes, blocks);
+  bytes += blocks * 64;
+  size -= blocks * 64;
+  std::memcpy(m_buffer, bytes, size);
+  m_buffered = size;
+}
+
+Sha256::Hash Sha256::finish() {
+  const uint64_t bits = m_length * 8;
+  uint8_t padding[72] = {0x80};
+  const size_t padded = (m_buffered < 56 ? 56 : 120) - m_buffered;
+  for (int i = 0; i < 8; ++i) {
+    padding[padded + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+  }
+  update(padding, padded + 8);
+  Hash hash;
+  for (int i = 0; i < 8; ++i) {
+    hash[4 * i] = static_cast<uint8_t>(m_state[i] >> 24);
+    hash[4 * i + 1] = static_cast<uint8_t>(m_state[i] >> 16);
+    hash[4 * i + 2] = static_cast<uint8_t>(m_state[i] >> 8);
+    hash[4 * i + 3] = static_cast<uint8_t>(m_state[i]);
+  }
+  return hash;
+}
+
+void Digest::update(const void *data, size_t size) {
+  switch (m_algorithm) {
+    case Crc32cDigest:
+      m_crc.update(data, size);
+      break;
+    case Sha256Digest:
+      m_sha.update(data, size);
+      break;
+    default:
+      break;
+  }
+}
+
+std::string Digest::value() {
+  switch (m_algorithm) {
+    case Crc32cDigest: {
+      const uint32_t crc = m_crc.value();
+      const uint8_t bytes[4] = {
+          static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+          static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc)};
+      return std::string(name(m_algorithm)) + ":" + toHex(bytes, 4);
+    }
+    case Sha256Digest: {
+      const Sha256::Hash hash = m_sha.finish();
+      return std::string(name(m_algorithm)) + ":" +
+             toHex(hash.data(), hash.size());
+    }
+    default:
+      return std::string();
+  }
+}
+
+const char *Digest::name(Algorithm algorithm) {
+  switch (algorithm) {
+    case Crc32cDigest:
+      return "crc32c";
+    case Sha256Digest:
+      return "sha256";
+    default:
+      return "none";
+  }
+}
+
+bool Digest::parseAlgorithm(const std::string &name, Algorithm &algorithm) {
+  const std::string lower = toLower(name);
+  if (lower == "crc32c") {
+    algorithm = Crc32cDigest;
+  } else if (lower == "sha256") {
+    algorithm = Sha256Digest;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Digest::parse(const std::string &text, Algorithm &algorithm,
+                   std::string &digest) {
+  std::string hex = toLower(text);
+  const size_t colon = hex.find(':');
+  if (colon != std::string::npos) {
+    if (!parseAlgorithm(hex.substr(0, colon), algorithm)) return false;
+    hex = hex.substr(colon + 1);
+  } else if (hex.size() == 64) {
+    algorithm = Sha256Digest;
+  } else if (hex.size() == 8) {
+    algorithm = Crc32cDigest;
+  } else {
+    return false;
+  }
+  if (hex.size() != (algorithm == Sha256Digest ? 64u : 8u) ||
+      hex.find_first_not_of("0123456789abcdef") != std::string::npos) {
+    return false;
+  }
+  digest = std::string(name(algorithm)) + ":" + hex;
+  return true;
+}
+
+bool Digest::fromManifest(const std::string &path, const std::string &file,
+                          Algorithm &algorithm, std::string &digest) {
+  std::ifstream manifest(path.c_str());
+  if (!manifest.is_open()) return false;
+  const std::string wanted = baseName(file);
+  std::string line;
+  while (std::getline(manifest, line)) {
+    std::istringstream fields(line);
+    std::string hex;
+    std::string name;
+    if (!(fields >> hex >> name)) continue;
+    // sha256sum marks binary mode with a '*' before the name.
+    if (name[0] == '*') name.erase(0, 1);
+    if (baseName(name) == wanted) return parse(hex, algorithm, digest);
+  }
+  return false;
+}
@@ -0,0 +1,283 @@
+#include <DirectorySync.h>
+#include <TFTPClient.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+
+DirectorySync::DirectorySync(const std::string &ip, uint16_t port,
+                             size_t jobs, const TransferOptions &options,
+                             ProgressRenderer::Output output,
+                             TransferPool::Report report,
+                             std::shared_ptr<AsyncLogger> log)
+    : m_options(options),
+      m_output(std::move(output)),
+      m_report(std::move(report)),
+      m_pool(ip, port, jobs,
+             [this](const TransferPool::Task &task,
+                    TransferSession::status code, const TransferStats &stats) {
+               finished(task, code, stats);
+             },
+             std::move(log)) {
+  // Sizes and digests only compare equal on the untranslated bytes.
+  m_options.mode = "octet";
+  m_options.sink.reset();
+  m_options.source.reset();
+}
+
+DirectorySync::status DirectorySync::run(const std::string &manifest,
+                                         const std::string &directory) {
+  const auto startTime = std::chrono::steady_clock::now();
+  m_summary = Summary();
+  m_directory = directory;
+  m_records.clear();
+  m_sizes.clear();
+  if (!readManifest(manifest)) return ManifestError;
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+  if (error) return DirectoryError;
+  loadState();
+  m_journal.open(localPath(m_stateName), std::ios_base::app);
+  if (!m_journal.is_open()) return DirectoryError;
+  m_summary.files = m_entries.size();
+
+  // Files whose record still holds only need their size checked.
+  std::vector<const Entry *> probed;
+  for (const Entry &entry : m_entries) {
+    if (current(entry)) {
+      probed.push_back(&entry);
+      TransferPool::Task task{TransferSession::Get, entry.name, m_options,
+                              std::string()};
+      task.options.probe = true;
+      task.options.digest = Digest::NoDigest;
+      task.options.expectedDigest.clear();
+      m_pool.submit(std::move(task));
+    } else {
+      fetch(entry);
+    }
+  }
+  m_pool.wait();
+
+  for (const Entry *entry : probed) {
+    const auto size = m_sizes.find(entry->name);
+    // A failed probe was already counted and reported.
+    if (size == m_sizes.end()) continue;
+    const Record &record = m_records[entry->name];
+    // Without a size from the server only a manifest digest vouches for
+    // the file.
+    const bool same = size->second.first
+                          ? size->second.second == record.size
+                          : !entry->digest.empty();
+    if (same) {
+      ++m_summary.unchanged;
+    } else {
+      fetch(*entry);
+    }
+  }
+  m_pool.wait();
+
+  m_journal.close();
+  const bool saved = saveState();
+  m_summary.seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - startTime)
+                          .count();
+  if (!saved) return DirectoryError;
+  return m_summary.failed == 0 ? Success : TransferFailed;
+}
+
+bool DirectorySync::readManifest(const std::string &path) {
+  std::ifstream manifest(path.c_str());
+  if (!manifest.is_open()) return false;
+  m_entries.clear();
+  std::string line;
+  while (std::getline(manifest, line)) {
+    const size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#') continue;
+    line.erase(0, begin);
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+
+    Entry entry;
+    entry.name = line;
+    const size_t gap = line.find_first_of(" \t");
+    Digest::Algorithm algorithm;
+    std::string digest;
+    if (gap != std::string::npos &&
+        Digest::parse(line.substr(0, gap), algorithm, digest)) {
+      entry.digest = digest;
+      entry.name = line.substr(line.find_first_not_of(" \t", gap));
+      // sha256sum marks binary mode with a '*' before the name.
+      if (entry.name[0] == '*') entry.name.erase(0, 1);
+    }
+
+    // Names stay inside the directory.
+    const std::filesystem::path name(entry.name);
+    bool inside = !name.is_absolute() && name != m_stateName;
+    for (const auto &part : name) inside &= part != "..";
+    if (!inside) {
+      print("sync " + entry.name + ": skipped, outside the directory.\n");
+      continue;
+    }
+    m_entries.push_back(std::move(entry));
+  }
+  return true;
+}
+
+// One line per written file, "<size> <modified> <digest|-> <name>"; the
+// last line for a name wins.
+void DirectorySync::loadState() {
+  std::ifstream state(localPath(m_stateName).c_str());
+  std::string line;
+  while (std::getline(state, line)) {
+    std::istringstream fields(line);
+    Record record;
+    std::string name;
+    if (!(fields >> record.size >> record.modified >> record.digest)) {
+      continue;
+    }
+    fields.get();
+    if (!std::getline(fields, name) || name.empty()) continue;
+    if (record.digest == "-") record.digest.clear();
+    m_records[name] = record;
+  }
+}
+
+bool DirectorySync::saveState() {
+  const std::string path = localPath(m_stateName);
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream state(temporary.c_str(), std::ios_base::trunc);
+    for (const auto &[name, record] : m_records) {
+      // Files removed since are forgotten.
+      Record local;
+      if (!stat(localPath(name), local)) continue;
+      state << record.size << ' ' << record.modified << ' '
+            << (record.digest.empty() ? "-" : record.digest) << ' ' << name
+            << '\n';
+    }
+    if (!state.flush()) return false;
+  }
+  return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool DirectorySync::appendState(const std::string &name,
+                                const Record &record) {
+  m_records[name] = record;
+  m_journal << record.size << ' ' << record.modified << ' '
+            << (record.digest.empty() ? "-" : record.digest) << ' ' << name
+            << '\n';
+  return static_cast<bool>(m_journal.flush());
+}
+
+bool DirectorySync::stat(const std::string &path, Record &record) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    return false;
+  }
+  record.size = static_cast<uint64_t>(info.st_size);
+  record.modified =
+      static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+      info.st_mtim.tv_nsec;
+  return true;
+}
+
+std::string DirectorySync::hash(const std::string &path,
+                                Digest::Algorithm algorithm) {
+  std::ifstream file(path.c_str(), std::ios_base::binary);
+  if (!file.is_open()) return std::string();
+  Digest digest(algorithm);
+  std::vector<char> buffer(1 << 20);
+  while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+    digest.update(buffer.data(), static_cast<size_t>(file.gcount()));
+  }
+  return file.bad() ? std::string() : digest.value();
+}
+
+bool DirectorySync::current(const Entry &entry) {
+  Record local;
+  if (!stat(localPath(entry.name), local)) return false;
+  const auto record = m_records.find(entry.name);
+  if (record != m_records.end() && record->second.size == local.size &&
+      record->second.modified == local.modified) {
+    const std::string &digest = record->second.digest;
+    if (entry.digest.empty() || entry.digest == digest) return true;
+    // Same algorithm, so the manifest names a new version.
+    if (entry.digest.substr(0, entry.digest.find(':')) ==
+        digest.substr(0, digest.find(':'))) {
+      return false;
+    }
+  }
+  // A file that was not written by a sync is taken over when it has the
+  // manifest's digest.
+  if (entry.digest.empty()) return false;
+  Digest::Algorithm algorithm;
+  std::string expected;
+  Digest::parse(entry.digest, algorithm, expected);
+  local.digest = hash(localPath(entry.name), algorithm);
+  if (local.digest != entry.digest) return false;
+  m_records[entry.name] = local;
+  return true;
+}
+
+void DirectorySync::fetch(const Entry &entry) {
+  const std::string path = localPath(entry.name);
+  std::error_code error;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), error);
+  TransferPool::Task task{TransferSession::Get, entry.name, m_options,
+                          path + m_partSuffix};
+  // The digest is taken on the data path for the state file, and checked
+  // against the manifest's.
+  task.options.probe = false;
+  if (entry.digest.empty()) {
+    task.options.digest = Digest::Sha256Digest;
+    task.options.expectedDigest.clear();
+  } else {
+    Digest::parse(entry.digest, task.options.digest,
+                  task.options.expectedDigest);
+  }
+  m_pool.submit(std::move(task));
+}
+
+// Called by the pool's workers, concurrently: files are moved in parallel,
+// the bookkeeping is serialised.
+void DirectorySync::finished(const TransferPool::Task &task,
+                             TransferSession::status code,
+                             const TransferStats &stats) {
+  if (m_report) m_report(task, code, stats);
+  const char *command = task.options.probe ? "probe" : "get";
+  if (code != TransferSession::Success) {
+    if (!task.options.probe) std::remove(task.localFile.c_str());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_summary.failed;
+    print("sync " + task.fileName + ": " + command + " " +
+          TFTPClient::errorDescription(code));
+    return;
+  }
+  if (task.options.probe) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sizes[task.fileName] = {stats.sizeKnown, stats.transferSize};
+    return;
+  }
+
+  const std::string path = localPath(task.fileName);
+  Record record;
+  const bool replaced =
+      std::rename(task.localFile.c_str(), path.c_str()) == 0 &&
+      stat(path, record);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!replaced) {
+    ++m_summary.failed;
+    print("sync " + task.fileName + ": Error! Can't replace file.\n");
+    return;
+  }
+  record.digest = stats.digest;
+  if (!appendState(task.fileName, record)) {
+    print("sync " + task.fileName + ": Error! Can't write state.\n");
+  }
+  ++m_summary.transferred;
+  m_summary.bytes += stats.bytes;
+  print("sync " + task.fileName + ": " + std::to_string(stats.bytes) +
+        " bytes\n");
+}
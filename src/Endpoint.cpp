@@ -0,0 +1,73 @@
+#include <Endpoint.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include <algorithm>
+#include <cstring>
+
+bool Endpoint::resolve(const std::string &host, uint16_t port, int family) {
+  struct addrinfo hints;
+  ::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+  struct addrinfo *results = nullptr;
+  const std::string service = std::to_string(port);
+  if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &results) != 0) {
+    m_length = 0;
+    return false;
+  }
+  assign(results->ai_addr, results->ai_addrlen);
+  ::freeaddrinfo(results);
+  return true;
+}
+
+void Endpoint::assign(const sockaddr *address, socklen_t length) {
+  m_length = std::min<socklen_t>(length, sizeof(m_address));
+  ::memset(&m_address, 0, sizeof(m_address));
+  ::memcpy(&m_address, address, m_length);
+}
+
+uint16_t Endpoint::port() const {
+  if (family() == AF_INET6) {
+    return ntohs(reinterpret_cast<const sockaddr_in6 *>(&m_address)->sin6_port);
+  }
+  return ntohs(reinterpret_cast<const sockaddr_in *>(&m_address)->sin_port);
+}
+
+void Endpoint::setPort(uint16_t port) {
+  if (family() == AF_INET6) {
+    reinterpret_cast<sockaddr_in6 *>(&m_address)->sin6_port = htons(port);
+  } else {
+    reinterpret_cast<sockaddr_in *>(&m_address)->sin_port = htons(port);
+  }
+}
+
+std::string Endpoint::host() const {
+  char text[INET6_ADDRSTRLEN] = "";
+  if (family() == AF_INET6) {
+    ::inet_ntop(AF_INET6,
+                &reinterpret_cast<const sockaddr_in6 *>(&m_address)->sin6_addr,
+                text, sizeof(text));
+  } else if (family() == AF_INET) {
+    ::inet_ntop(AF_INET,
+                &reinterpret_cast<const sockaddr_in *>(&m_address)->sin_addr,
+                text, sizeof(text));
+  }
+  return text;
+}
+
+bool Endpoint::operator==(const Endpoint &other) const {
+  if (family() != other.family() || port() != other.port()) return false;
+  if (family() == AF_INET6) {
+    return ::memcmp(
+               &reinterpret_cast<const sockaddr_in6 *>(&m_address)->sin6_addr,
+               &reinterpret_cast<const sockaddr_in6 *>(&other.m_address)
+                    ->sin6_addr,
+               sizeof(in6_addr)) == 0;
+  }
+  return reinterpret_cast<const sockaddr_in *>(&m_address)->sin_addr.s_addr ==
+         reinterpret_cast<const sockaddr_in *>(&other.m_address)
+             ->sin_addr.s_addr;
+}
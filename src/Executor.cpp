@@ -0,0 +1,24 @@
+#include <Executor.h>
+
+Executor::Detached Executor::detach(Executor &executor, Task<void> task) {
+  co_await task;
+  --executor.m_detached;
+}
+
+void Executor::spawn(Task<void> task) {
+  ++m_detached;
+  schedule(detach(*this, std::move(task)).handle);
+}
+
+void Executor::run() {
+  while (true) {
+    while (!m_ready.empty()) {
+      const std::coroutine_handle<> coroutine = m_ready.front();
+      m_ready.pop_front();
+      coroutine.resume();
+    }
+    // Without transfers in flight nothing could resume a suspended task.
+    if (m_engine.active() == 0) return;
+    m_engine.poll();
+  }
+}
@@ -0,0 +1,54 @@
+#include <FileCache.h>
+
+static bool sameFile(const struct stat &info, dev_t device, ino_t inode,
+                     off_t size, const struct timespec &modified) {
+  return info.st_dev == device && info.st_ino == inode &&
+         info.st_size == size && info.st_mtim.tv_sec == modified.tv_sec &&
+         info.st_mtim.tv_nsec == modified.tv_nsec;
+}
+
+FileCache::Mapping FileCache::get(const std::string &path) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) == -1 || !S_ISREG(info.st_mode)) {
+    return nullptr;
+  }
+  auto found = m_entries.find(path);
+  if (found != m_entries.end()) {
+    Entry &entry = found->second;
+    if (sameFile(info, entry.device, entry.inode, entry.size,
+                 entry.modified)) {
+      ++m_hits;
+      m_recent.splice(m_recent.begin(), m_recent, entry.recent);
+      return entry.mapping;
+    }
+    erase(found);
+  }
+
+  ++m_misses;
+  const uint64_t size = static_cast<uint64_t>(info.st_size);
+  auto mapping = std::make_shared<MappedFile>();
+  // Files beyond the whole budget are streamed, not pinned.
+  if (!mapping->open(path, size <= m_capacity)) return nullptr;
+  if (size > m_capacity) return mapping;
+
+  while (m_bytes + size > m_capacity && !m_recent.empty()) {
+    erase(m_entries.find(m_recent.back()));
+  }
+  m_recent.push_front(path);
+  m_entries.emplace(path, Entry{mapping, info.st_dev, info.st_ino,
+                                info.st_size, info.st_mtim, m_recent.begin()});
+  m_bytes += size;
+  return mapping;
+}
+
+void FileCache::clear() {
+  m_entries.clear();
+  m_recent.clear();
+  m_bytes = 0;
+}
+
+void FileCache::erase(std::unordered_map<std::string, Entry>::iterator entry) {
+  m_bytes -= static_cast<uint64_t>(entry->second.size);
+  m_recent.erase(entry->second.recent);
+  m_entries.erase(entry);
+}
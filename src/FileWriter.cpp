@@ -0,0 +1,191 @@
+#include <FileWriter.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+FileWriter::FileWriter(size_t chunkSize, size_t chunks)
+    : m_chunkSize((std::max(chunkSize, m_alignment) + m_alignment - 1) /
+                  m_alignment * m_alignment),
+      m_chunks(std::max<size_t>(chunks, 2)) {}
+
+FileWriter::~FileWriter() {
+  close();
+  for (Chunk &chunk : m_chunks) std::free(chunk.data);
+}
+
+bool FileWriter::open(const std::string &path, bool direct) {
+  close();
+  for (Chunk &chunk : m_chunks) {
+    if (chunk.data == nullptr) {
+      void *memory = nullptr;
+      if (::posix_memalign(&memory, m_alignment, m_chunkSize) != 0) {
+        return false;
+      }
+      chunk.data = static_cast<char *>(memory);
+    }
+    chunk.length = 0;
+  }
+
+  const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  m_direct = false;
+  if (direct) {
+    m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    m_direct = m_fd != -1;
+  }
+  if (m_fd == -1) m_fd = ::open(path.c_str(), flags, 0644);
+  if (m_fd == -1) return false;
+
+  m_offset = 0;
+  m_stall = std::chrono::microseconds(0);
+  m_head = m_tail = m_queued = 0;
+  m_stopping = m_abort = false;
+  m_error = 0;
+  m_thread = std::thread(&FileWriter::run, this);
+  return true;
+}
+
+bool FileWriter::write(const char *data, size_t size) {
+  while (size > 0) {
+    if (error() != 0) return false;
+    Chunk &chunk = m_chunks[m_tail];
+    const size_t copied = std::min(size, m_chunkSize - chunk.length);
+    if (chunk.length == 0) chunk.offset = m_offset;
+    ::memcpy(chunk.data + chunk.length, data, copied);
+    chunk.length += copied;
+    m_offset += copied;
+    data += copied;
+    size -= copied;
+    if (chunk.length == m_chunkSize && !queue()) return false;
+  }
+  return error() == 0;
+}
+
+bool FileWriter::skip(size_t size) {
+  // The skipped bytes are zeros, so chunks may be rounded out into them:
+  // the queued one ends and the next begins on an alignment boundary, as
+  // O_DIRECT needs. Less than a whole page is simply written.
+  const uint64_t end = m_offset + size;
+  const uint64_t holeStart =
+      (m_offset + m_alignment - 1) / m_alignment * m_alignment;
+  const uint64_t holeEnd = end / m_alignment * m_alignment;
+  if (holeEnd <= holeStart) return writeZeros(size);
+  if (!writeZeros(holeStart - m_offset)) return false;
+  if (m_chunks[m_tail].length > 0 && !queue()) return false;
+  m_offset = holeEnd;
+  return writeZeros(end - holeEnd);
+}
+
+bool FileWriter::writeZeros(uint64_t size) {
+  static const char zeros[m_alignment] = {};
+  for (; size > 0; size -= std::min<uint64_t>(size, sizeof(zeros))) {
+    if (!write(zeros, std::min<uint64_t>(size, sizeof(zeros)))) return false;
+  }
+  return error() == 0;
+}
+
+bool FileWriter::queue() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_tail = (m_tail + 1) % m_chunks.size();
+  ++m_queued;
+  m_ready.notify_one();
+  // The next chunk to fill must not still be waiting for the disk.
+  const auto ready = [this] {
+    return m_queued < m_chunks.size() || m_error != 0;
+  };
+  if (!ready()) {
+    const auto start = std::chrono::steady_clock::now();
+    m_space.wait(lock, ready);
+    m_stall += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+  }
+  return m_error == 0;
+}
+
+bool FileWriter::finish() {
+  if (m_fd == -1) return false;
+  Chunk &tail = m_chunks[m_tail];
+  if (tail.length > 0) {
+    if (m_direct) {
+      // O_DIRECT wants whole blocks, the padding is cut off below.
+      const size_t padded =
+          (tail.length + m_alignment - 1) / m_alignment * m_alignment;
+      ::memset(tail.data + tail.length, 0, padded - tail.length);
+      tail.length = padded;
+    }
+    queue();
+  }
+  const auto start = std::chrono::steady_clock::now();
+  stop(true);
+  m_stall += std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  int result = m_error;
+  if (result == 0 && m_direct &&
+      ::ftruncate(m_fd, static_cast<off_t>(m_offset)) == -1) {
+    result = errno;
+  }
+  if (::close(m_fd) == -1 && result == 0) result = errno;
+  m_fd = -1;
+  m_error = result;
+  return result == 0;
+}
+
+void FileWriter::close() {
+  if (m_fd == -1) return;
+  stop(false);
+  ::close(m_fd);
+  m_fd = -1;
+}
+
+int FileWriter::error() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_error;
+}
+
+void FileWriter::stop(bool drain) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_abort = !drain;
+  }
+  m_ready.notify_one();
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void FileWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_ready.wait(lock, [this] { return m_queued > 0 || m_stopping; });
+    if (m_abort || m_queued == 0) return;
+    Chunk &chunk = m_chunks[m_head];
+    const bool skip = m_error != 0;
+    lock.unlock();
+    const int error = skip ? 0 : writeChunk(chunk);
+    lock.lock();
+    if (error != 0 && m_error == 0) m_error = error;
+    chunk.length = 0;
+    m_head = (m_head + 1) % m_chunks.size();
+    --m_queued;
+    m_space.notify_one();
+  }
+}
+
+int FileWriter::writeChunk(const Chunk &chunk) {
+  size_t done = 0;
+  while (done < chunk.length) {
+    const ssize_t written =
+        ::pwrite(m_fd, chunk.data + done, chunk.length - done,
+                 static_cast<off_t>(chunk.offset + done));
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    if (written == 0) return EIO;
+    done += static_cast<size_t>(written);
+  }
+  return 0;
+}
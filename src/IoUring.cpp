@@ -0,0 +1,188 @@
+#include <IoUring.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete,
+                          unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit,
+                                    minComplete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg,
+                             unsigned count) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+IoUring::~IoUring() {
+  if (m_sqes != nullptr) ::munmap(m_sqes, m_sqesSize);
+  if (m_cqRing != nullptr && m_cqRing != m_sqRing)
+    ::munmap(m_cqRing, m_cqRingSize);
+  if (m_sqRing != nullptr) ::munmap(m_sqRing, m_sqRingSize);
+  if (m_fd != -1) ::close(m_fd);
+}
+
+bool IoUring::init(unsigned entries) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  const int fd = io_uring_setup(entries, &params);
+  if (fd < 0) return false;
+  m_fd = fd;
+
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMap) m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+  m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  if (m_sqRing == MAP_FAILED) {
+    m_sqRing = nullptr;
+    return false;
+  }
+  if (singleMap) {
+    m_cqRing = m_sqRing;
+  } else {
+    m_cqRing = ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (m_cqRing == MAP_FAILED) {
+      m_cqRing = nullptr;
+      return false;
+    }
+  }
+  m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return false;
+  m_sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(m_sqRing);
+  m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  m_sqEntries = params.sq_entries;
+  m_sqeTail = *m_sqTail;
+
+  char *cq = static_cast<char *>(m_cqRing);
+  m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+  return true;
+}
+
+struct io_uring_sqe *IoUring::sqe() {
+  if (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+    submit(0);
+    if (m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+      return nullptr;
+  }
+  const unsigned index = m_sqeTail & *m_sqMask;
+  m_sqArray[index] = index;
+  ++m_sqeTail;
+  ++m_toSubmit;
+  struct io_uring_sqe *entry = &m_sqes[index];
+  std::memset(entry, 0, sizeof(*entry));
+  return entry;
+}
+
+int IoUring::submit(unsigned waitFor) {
+  __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+  int submitted;
+  do {
+    submitted = io_uring_enter(m_fd, m_toSubmit, waitFor,
+                               waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+  } while (submitted < 0 && errno == EINTR);
+  if (submitted > 0) m_toSubmit -= std::min<unsigned>(submitted, m_toSubmit);
+  return submitted;
+}
+
+int IoUring::transferMessages(uint8_t opcode, int fd, struct mmsghdr *messages,
+                              size_t count, bool link) {
+  int results[UIO_MAXIOV];
+  count = std::min<size_t>(count, UIO_MAXIOV);
+  size_t queued = 0;
+  for (; queued < count; ++queued) {
+    struct io_uring_sqe *entry = sqe();
+    if (entry == nullptr) break;
+    entry->opcode = opcode;
+    entry->fd = fd;
+    entry->addr = reinterpret_cast<uintptr_t>(&messages[queued].msg_hdr);
+    entry->len = 1;
+    entry->msg_flags = MSG_DONTWAIT;
+    // A linked chain stops at the first failure (EAGAIN on an empty
+    // socket) and cancels the rest, keeping datagrams in order.
+    if (link && queued + 1 < count) entry->flags = IOSQE_IO_LINK;
+    entry->user_data = m_socketTag | queued;
+  }
+  if (queued == 0) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (link && queued < count) {
+    m_sqes[(m_sqeTail - 1) & *m_sqMask].flags &= ~IOSQE_IO_LINK;
+  }
+
+  size_t completed = 0;
+  if (submit(queued) < 0) return -1;
+  while (true) {
+    reap([&](const struct io_uring_cqe &cqe) {
+      results[cqe.user_data & ~m_socketTag] = cqe.res;
+      ++completed;
+    });
+    if (completed >= queued) break;
+    if (submit(1) < 0) return -1;
+  }
+
+  size_t done = 0;
+  while (done < queued && results[done] >= 0) {
+    messages[done].msg_len = results[done];
+    ++done;
+  }
+  if (done == 0) {
+    errno = -results[0];
+    return -1;
+  }
+  return static_cast<int>(done);
+}
+
+int IoUring::registerBuffers(const struct iovec *buffers, unsigned count) {
+  return io_uring_register(m_fd, IORING_REGISTER_BUFFERS, buffers, count);
+}
+
+int IoUring::unregisterBuffers() {
+  return io_uring_register(m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+}
+
+void IoUring::completeFileOp(const struct io_uring_cqe &cqe) {
+  if (m_filePending > 0) --m_filePending;
+  if (m_fileError != 0) return;
+  if (cqe.res < 0) {
+    m_fileError = -cqe.res;
+  } else if (static_cast<uint64_t>(cqe.res) != cqe.user_data) {
+    m_fileError = EIO;
+  }
+}
+
+int IoUring::waitFileOps() {
+  while (m_filePending > 0) {
+    if (submit(1) < 0) {
+      if (m_fileError == 0) m_fileError = errno;
+      break;
+    }
+    reap([](const struct io_uring_cqe &) {});
+  }
+  return m_fileError;
+}
@@ -0,0 +1,74 @@
+#include <MappedFile.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+thread_local sigjmp_buf *t_guard = nullptr;
+struct sigaction s_previous;
+
+void onBusError(int signal, siginfo_t *info, void *) {
+  if (t_guard != nullptr && info->si_code == BUS_ADRERR) {
+    siglongjmp(*t_guard, 1);
+  }
+  // Not a guarded read: whatever handled SIGBUS before does.
+  ::sigaction(SIGBUS, &s_previous, nullptr);
+  ::raise(signal);
+}
+
+}  // namespace
+
+sigjmp_buf *&MappedFile::guard() {
+  static const bool installed = [] {
+    struct sigaction action = {};
+    action.sa_sigaction = onBusError;
+    // Not blocked in the handler, as the jump out doesn't restore the mask.
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    return ::sigaction(SIGBUS, &action, &s_previous) == 0;
+  }();
+  (void)installed;
+  return t_guard;
+}
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &path, bool preload) {
+  close();
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+
+  struct stat info;
+  if (::fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+  m_size = static_cast<size_t>(info.st_size);
+  if (m_size > 0) {
+    void *mapping = ::mmap(nullptr, m_size, PROT_READ,
+                           MAP_PRIVATE | (preload ? MAP_POPULATE : 0), fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      m_size = 0;
+      return false;
+    }
+    ::madvise(mapping, m_size, preload ? MADV_WILLNEED : MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(mapping);
+  }
+  ::close(fd);
+  m_open = true;
+  return true;
+}
+
+void MappedFile::close() {
+  if (m_data != nullptr) {
+    ::munmap(const_cast<char *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_open = false;
+}
@@ -0,0 +1,412 @@
+#include <MulticastSession.h>
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using boost::format;
+
+namespace {
+
+constexpr uint8_t m_headerSize = TransferSession::m_headerSize;
+
+// Maps a 16-bit block number onto the absolute block closest to reference.
+uint32_t absoluteBlock(uint16_t block, uint32_t reference) {
+  const uint32_t candidate = (reference & ~0xffffu) | block;
+  if (candidate + 0x8000 < reference) return candidate + 0x10000;
+  if (candidate > reference + 0x8000 && candidate >= 0x10000) {
+    return candidate - 0x10000;
+  }
+  return candidate;
+}
+
+}  // namespace
+
+MulticastSession::MulticastSession(Socket &socket, const std::string &ip,
+                                   uint16_t port,
+                                   const std::string &remoteFile,
+                                   const std::string &localFile,
+                                   const TransferOptions &options,
+                                   const RttEstimator &rtt)
+    : m_socket(socket),
+      m_remoteAddress(ip),
+      m_port(port),
+      m_remoteFile(remoteFile),
+      m_localFile(localFile),
+      m_options(options),
+      m_rtt(rtt) {}
+
+MulticastSession::~MulticastSession() {
+  if (m_file != -1) ::close(m_file);
+}
+
+MulticastSession::status MulticastSession::start(Clock::time_point now) {
+  m_startTime = now;
+  m_stats.file = m_remoteFile;
+  m_stats.direction = "get";
+  if (m_remoteFile.empty()) {
+    fail(status::EmptyFilename);
+    return m_result;
+  }
+  if (!m_server.resolve(m_remoteAddress, m_port, m_socket.GetFamily())) {
+    m_errorMessage = "Can't resolve " + m_remoteAddress + "!";
+    fail(status::InvalidSocket);
+    return m_result;
+  }
+  // Answers come from the server's transfer ID, re-requests go to its
+  // port, so the socket stays unconnected.
+  m_socket.Disconnect();
+  m_file = ::open(m_localFile.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_file == -1) {
+    m_errorMessage = "Can't open file!";
+    fail(status::OpenFileError);
+    return m_result;
+  }
+
+  const Packet::Number blockSize(m_options.blockSize);
+  Packet::Option options[2] = {{"multicast", ""}};
+  size_t count = 1;
+  if (m_options.blockSize != TransferSession::m_defaultBlockSize) {
+    options[count++] = {"blksize", blockSize.view()};
+  }
+  const std::span<const Packet::Option> requested(options, count);
+  m_request.assign(Packet::requestSize(m_remoteFile, "octet", requested), 0);
+  Packet::request(m_request, Packet::RRQ, m_remoteFile, "octet", requested);
+  m_buffer.assign(m_headerSize + std::max(m_options.blockSize,
+                                          TransferSession::m_defaultBlockSize),
+                  0);
+  // Drop datagrams left over from an earlier transfer on the same socket.
+  while (m_socket.RecvFrom(&m_buffer[0], m_buffer.size()) > 0) {
+  }
+
+  m_state = Requesting;
+  if (!sendRequest()) return m_result;
+  m_rttStart = now;
+  m_rttPending = true;
+  m_deadline = now + m_rtt.timeout();
+  return status::Success;
+}
+
+bool MulticastSession::sendPacket(const char *packet, size_t size,
+                                  const Endpoint *to) {
+  ++m_packets;
+  const int sent = m_socket.SendTo(packet, size, to);
+  if (sent == static_cast<int>(size)) return true;
+  // A full socket buffer is just another lost packet, the timer recovers.
+  if (sent == -1 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+    return true;
+  }
+  fail(status::WriteError);
+  return false;
+}
+
+bool MulticastSession::sendRequest() {
+  return sendPacket(&m_request[0], m_request.size(), &m_server);
+}
+
+bool MulticastSession::sendAck(uint32_t block) {
+  char packet[m_headerSize];
+  return sendPacket(packet, Packet::ack(packet, static_cast<uint16_t>(block)),
+                    &m_peer);
+}
+
+bool MulticastSession::sendError(uint16_t code, const std::string &message) {
+  char packet[m_headerSize + TransferSession::m_defaultBlockSize];
+  return sendPacket(packet, Packet::error(packet, code, message), &m_peer);
+}
+
+void MulticastSession::onReadable(Clock::time_point now) {
+  receive(m_socket, false, now);
+  if (m_group && !finished()) receive(*m_group, true, now);
+}
+
+void MulticastSession::receive(Socket &socket, bool group,
+                               Clock::time_point now) {
+  Endpoint from;
+  while (!finished()) {
+    const int size = socket.RecvFrom(&m_buffer[0], m_buffer.size(), &from);
+    if (size < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        fail(status::ReadError);
+      }
+      return;
+    }
+    ++m_packets;
+    if (m_remotePort == 0 && !group) {
+      // The first answer from the server's address fixes its transfer ID
+      // (RFC 1350, 4).
+      Endpoint server = m_server;
+      server.setPort(from.port());
+      if (from != server) continue;
+      m_remotePort = from.port();
+      m_peer = from;
+    }
+    // The group may carry other transfers; only our server's count.
+    if (m_remotePort == 0 || from != m_peer) continue;
+    handlePacket(&m_buffer[0], static_cast<size_t>(size), now);
+  }
+}
+
+void MulticastSession::handlePacket(const char *packet, size_t size,
+                                    Clock::time_point now) {
+  PacketView view;
+  const PacketView::Result parsed = view.parse({packet, size});
+  if (parsed == PacketView::UnknownOperation) {
+    m_errorMessage = (format("Unexpected packet received! Type: %i.") %
+                      view.operation())
+                         .str();
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  if (parsed != PacketView::Valid) return;
+  switch (view.operation()) {
+    case Packet::DATA:
+      handleData(view.block(), view.payload().data(), view.payload().size(),
+                 now);
+      break;
+    case Packet::OACK:
+      handleOptionAck(view.options(), now);
+      break;
+    case Packet::ERR:
+      m_errorMessage = (format("Message from remote host: %s.") %
+                        std::string(view.errorMessage()))
+                           .str();
+      fail(status::ReadError);
+      break;
+    default:
+      m_errorMessage = (format("Unexpected packet received! Type: %i.") %
+                        view.operation())
+                           .str();
+      fail(status::UnexpectedPacketReceived);
+      break;
+  }
+}
+
+void MulticastSession::handleOptionAck(const OptionList &options,
+                                       Clock::time_point now) {
+  bool multicast = false;
+  std::string address;
+  uint64_t groupPort = 0;
+  bool masterFlag = false;
+  for (const Packet::Option &option : options) {
+    if (Packet::sameName(option.name, "multicast")) {
+      // "addr,port,mc"; address and port may be left out once joined.
+      const std::string_view text = option.value;
+      const size_t first = text.find(',');
+      const size_t second = first == std::string_view::npos
+                                ? first
+                                : text.find(',', first + 1);
+      if (second == std::string_view::npos) break;
+      multicast = true;
+      address = std::string(text.substr(0, first));
+      Packet::parseNumber(text.substr(first + 1, second - first - 1),
+                          groupPort);
+      masterFlag = text.substr(second + 1) == "1";
+    } else if (Packet::sameName(option.name, "blksize") &&
+               m_state == Requesting) {
+      uint64_t blockSize = 0;
+      if (!Packet::parseNumber(option.value, blockSize) ||
+          blockSize < TransferSession::m_minBlockSize ||
+          blockSize > m_options.blockSize) {
+        break;
+      }
+      m_blockSize = static_cast<uint16_t>(blockSize);
+    }
+  }
+
+  if (!multicast && !m_group) {
+    // RFC 2347: a client turns down an unwanted OACK with error 8.
+    m_declined = true;
+    sendError(8, "Multicast option required");
+    m_errorMessage = "Server doesn't support multicast.";
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  if (!address.empty() && !m_group) {
+    if (groupPort == 0 || groupPort > 65535 ||
+        !joinGroup(address, static_cast<uint16_t>(groupPort))) {
+      m_errorMessage = "Can't join multicast group " + address + "!";
+      sendError(0, "Can't join group");
+      fail(status::InvalidSocket);
+      return;
+    }
+  }
+  if (!m_group) {
+    // The OACK naming the group got lost; asking again repeats it.
+    sendRequest();
+    return;
+  }
+  if (m_state == Requesting) {
+    m_state = Transferring;
+    if (m_rttPending) {
+      m_rttPending = false;
+      const auto sample =
+          std::chrono::duration_cast<RttEstimator::Duration>(now - m_rttStart);
+      m_rtt.sample(sample);
+      m_stats.recordRtt(sample);
+    }
+  }
+  m_retries = 0;
+  m_deadline = now + m_rtt.timeout();
+  if (multicast) m_master = masterFlag;
+  if (m_master) requestNext(now);
+}
+
+bool MulticastSession::joinGroup(const std::string &address, uint16_t port) {
+  Endpoint group;
+  Endpoint local;
+  if (!group.resolve(address, port, m_socket.GetFamily())) return false;
+  std::unique_ptr<UDPSocket> socket(new UDPSocket(group.family()));
+  if (socket->GetDescriptor() == -1) return false;
+  {
+    // Join on the interface that reaches the server.
+    UDPSocket route(m_server.family());
+    if (!route.Connect(m_server) || !route.GetLocalEndpoint(local)) {
+      return false;
+    }
+  }
+  // Every client on this host binds the same group port.
+  if (!socket->Bind(group, true) || !socket->JoinGroup(group, local)) {
+    return false;
+  }
+  m_group = std::move(socket);
+  return true;
+}
+
+bool MulticastSession::received(uint32_t block) const {
+  const size_t index = block - 1;
+  return index / 64 < m_received.size() &&
+         (m_received[index / 64] >> (index % 64)) & 1;
+}
+
+void MulticastSession::handleData(uint16_t number, const char *data,
+                                  size_t payload, Clock::time_point now) {
+  if (m_state == Requesting) {
+    // A plain RFC 1350 server answered with DATA straight away.
+    m_declined = true;
+    sendError(8, "Multicast option required");
+    m_errorMessage = "Server doesn't support multicast.";
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  // A master is sent what it asked for, the others follow the stream.
+  const uint32_t reference =
+      m_master || m_highestBlock == 0 ? m_firstMissing : m_highestBlock;
+  const uint32_t block = absoluteBlock(number, reference);
+  if (block == 0 || payload > m_blockSize ||
+      (m_finalBlock != 0 && block > m_finalBlock)) {
+    return;
+  }
+  // The transfer is alive, even when it only repeats what we have.
+  m_retries = 0;
+  m_deadline = now + m_rtt.timeout();
+  if (received(block)) {
+    // Repeats don't get ACKed again, that would multiply them.
+    ++m_stats.duplicates;
+    return;
+  }
+
+  const off_t offset = static_cast<off_t>(block - 1) * m_blockSize;
+  if (::pwrite(m_file, data, payload, offset) !=
+      static_cast<ssize_t>(payload)) {
+    fail(status::WriteFileError);
+    return;
+  }
+  const size_t index = block - 1;
+  if (index / 64 >= m_received.size()) m_received.resize(index / 64 + 1, 0);
+  m_received[index / 64] |= uint64_t(1) << (index % 64);
+  if (!m_stats.firstByte) {
+    m_stats.firstByte = true;
+    m_stats.timeToFirstByte =
+        std::chrono::duration_cast<TransferStats::Duration>(now - m_startTime);
+  }
+  m_bytes += payload;
+  ++m_stats.blocks;
+  if (payload < m_blockSize) m_finalBlock = block;
+  m_highestBlock = std::max(m_highestBlock, block);
+  while (received(m_firstMissing)) ++m_firstMissing;
+
+  if (!m_master) return;
+  if (m_rttPending) {
+    m_rttPending = false;
+    const auto sample =
+        std::chrono::duration_cast<RttEstimator::Duration>(now - m_rttStart);
+    m_rtt.sample(sample);
+    m_stats.recordRtt(sample);
+  }
+  requestNext(now);
+}
+
+void MulticastSession::requestNext(Clock::time_point now) {
+  if (complete()) {
+    // The final ACK hands the master role on to the next client.
+    if (sendAck(m_finalBlock)) finish();
+    return;
+  }
+  if (!sendAck(m_firstMissing - 1)) return;
+  m_rttStart = now;
+  m_rttPending = true;
+  m_deadline = now + m_rtt.timeout();
+}
+
+bool MulticastSession::onTimeout(Clock::time_point now) {
+  if (finished() || now < m_deadline) return false;
+  if (complete()) {
+    // Every block came in over the group; waiting to be made master again
+    // gains nothing. The final ACK tells the server all the same.
+    if (sendAck(m_finalBlock)) finish();
+    return false;
+  }
+
+  m_rtt.backoff();
+  m_rttPending = false;
+  ++m_stats.timeouts;
+  if (++m_retries > TransferSession::m_maxRetries) {
+    fail(status::TimeOut);
+    return true;
+  }
+  m_deadline = now + m_rtt.timeout();
+  ++m_stats.retransmits;
+  if (m_master) {
+    requestNext(now);
+  } else {
+    // Requesting, or a quiet group: asking again makes the server
+    // repeat its OACK, possibly from a new transfer ID.
+    m_remotePort = 0;
+    sendRequest();
+  }
+  return true;
+}
+
+void MulticastSession::finish() {
+  m_state = Done;
+  m_result = status::Success;
+  if (m_file != -1 && ::close(m_file) != 0) m_result = status::WriteFileError;
+  m_file = -1;
+  if (m_result != status::Success) m_state = Failed;
+  finishStats();
+}
+
+void MulticastSession::fail(status code) {
+  m_state = Failed;
+  m_result = code;
+  if (m_file != -1) ::close(m_file);
+  m_file = -1;
+  finishStats();
+}
+
+void MulticastSession::finishStats() {
+  m_group.reset();
+  m_stats.result = m_result;
+  m_stats.bytes = m_bytes;
+  m_stats.packets = m_packets;
+  m_stats.duration = std::chrono::duration_cast<TransferStats::Duration>(
+      Clock::now() - m_startTime);
+}
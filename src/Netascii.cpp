@@ -0,0 +1,94 @@
+#include <Netascii.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+size_t ScalarScanner::findCr(const char *data, size_t size) {
+  const void *found = std::memchr(data, '\r', size);
+  return found == nullptr ? size : static_cast<const char *>(found) - data;
+}
+
+size_t ScalarScanner::findLineEnd(const char *data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] == '\r' || data[i] == '\n') return i;
+  }
+  return size;
+}
+
+#if defined(__SSE2__)
+size_t Sse2Scanner::findCr(const char *data, size_t size) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, cr));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + ScalarScanner::findCr(data + i, size - i);
+}
+
+size_t Sse2Scanner::findLineEnd(const char *data, size_t size) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, lf)));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + ScalarScanner::findLineEnd(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t Avx2Scanner::findCr(const char *data,
+                                                            size_t size) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr)));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + Sse2Scanner::findCr(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t Avx2Scanner::findLineEnd(
+    const char *data, size_t size) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, cr),
+                        _mm256_cmpeq_epi8(block, lf))));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + Sse2Scanner::findLineEnd(data + i, size - i);
+}
+
+namespace {
+
+bool hasAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+}  // namespace
+
+size_t DispatchScanner::findCr(const char *data, size_t size) {
+  return hasAvx2() ? Avx2Scanner::findCr(data, size)
+                   : Sse2Scanner::findCr(data, size);
+}
+
+size_t DispatchScanner::findLineEnd(const char *data, size_t size) {
+  return hasAvx2() ? Avx2Scanner::findLineEnd(data, size)
+                   : Sse2Scanner::findLineEnd(data, size);
+}
+#endif
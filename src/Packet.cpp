@@ -0,0 +1,183 @@
+#include <Packet.h>
+
+#include <cstring>
+#include <strings.h>
+
+namespace {
+
+void writeShort(char *out, uint16_t value) {
+  out[0] = static_cast<char>(value >> 8);
+  out[1] = static_cast<char>(value & 0xff);
+}
+
+uint16_t readShort(const char *data) {
+  return static_cast<uint16_t>((static_cast<uint8_t>(data[0]) << 8) |
+                               static_cast<uint8_t>(data[1]));
+}
+
+char *writeString(char *out, std::string_view text) {
+  std::memcpy(out, text.data(), text.size());
+  out[text.size()] = '\0';
+  return out + text.size() + 1;
+}
+
+char *writeOptions(char *out, std::span<const Packet::Option> options) {
+  for (const Packet::Option &option : options) {
+    out = writeString(out, option.name);
+    out = writeString(out, option.value);
+  }
+  return out;
+}
+
+// The NUL terminated string at `at`, which then moves past it.
+bool readString(const char *&at, const char *end, std::string_view &text) {
+  const char *nul =
+      static_cast<const char *>(std::memchr(at, '\0', end - at));
+  if (nul == nullptr) return false;
+  text = std::string_view(at, nul - at);
+  at = nul + 1;
+  return true;
+}
+
+}  // namespace
+
+size_t Packet::request(std::span<char> out, OperationCode code,
+                       std::string_view file, std::string_view mode,
+                       std::span<const Option> options) {
+  const size_t size = requestSize(file, mode, options);
+  if (out.size() < size) return 0;
+  writeShort(out.data(), code);
+  char *end = writeString(out.data() + m_opcodeSize, file);
+  end = writeString(end, mode);
+  writeOptions(end, options);
+  return size;
+}
+
+size_t Packet::dataHeader(std::span<char> out, uint16_t block) {
+  if (out.size() < m_headerSize) return 0;
+  writeShort(out.data(), DATA);
+  writeShort(out.data() + m_opcodeSize, block);
+  return m_headerSize;
+}
+
+size_t Packet::data(std::span<char> out, uint16_t block,
+                    std::span<const char> payload) {
+  if (out.size() < m_headerSize + payload.size()) return 0;
+  dataHeader(out, block);
+  if (!payload.empty()) {
+    std::memcpy(out.data() + m_headerSize, payload.data(), payload.size());
+  }
+  return m_headerSize + payload.size();
+}
+
+size_t Packet::ack(std::span<char> out, uint16_t block) {
+  if (out.size() < m_headerSize) return 0;
+  writeShort(out.data(), ACK);
+  writeShort(out.data() + m_opcodeSize, block);
+  return m_headerSize;
+}
+
+size_t Packet::error(std::span<char> out, uint16_t code,
+                     std::string_view message) {
+  const size_t size = m_headerSize + message.size() + 1;
+  if (out.size() < size) return 0;
+  writeShort(out.data(), ERR);
+  writeShort(out.data() + m_opcodeSize, code);
+  writeString(out.data() + m_headerSize, message);
+  return size;
+}
+
+size_t Packet::optionAck(std::span<char> out,
+                         std::span<const Option> options) {
+  const size_t size = m_opcodeSize + optionsSize(options);
+  if (out.size() < size) return 0;
+  writeShort(out.data(), OACK);
+  writeOptions(out.data() + m_opcodeSize, options);
+  return size;
+}
+
+bool Packet::sameName(std::string_view name, std::string_view wanted) {
+  return name.size() == wanted.size() &&
+         strncasecmp(name.data(), wanted.data(), name.size()) == 0;
+}
+
+bool Packet::parseNumber(std::string_view text, uint64_t &value) {
+  const char *end = text.data() + text.size();
+  const std::from_chars_result parsed =
+      std::from_chars(text.data(), end, value);
+  return !text.empty() && parsed.ec == std::errc() && parsed.ptr == end;
+}
+
+Packet::Option OptionList::iterator::operator*() const {
+  const std::string_view name(m_at);
+  return {name, std::string_view(m_at + name.size() + 1)};
+}
+
+OptionList::iterator &OptionList::iterator::operator++() {
+  const Packet::Option option = **this;
+  m_at = option.value.data() + option.value.size() + 1;
+  return *this;
+}
+
+bool OptionList::find(std::string_view name, std::string_view &value) const {
+  for (const Packet::Option &option : *this) {
+    if (Packet::sameName(option.name, name)) {
+      value = option.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+PacketView::Result PacketView::parse(std::span<const char> datagram) {
+  *this = PacketView();
+  if (datagram.size() < Packet::m_opcodeSize) return Truncated;
+  const char *data = datagram.data();
+  const char *end = data + datagram.size();
+  m_operation = readShort(data);
+  if (!Packet::known(m_operation)) return UnknownOperation;
+  if (datagram.size() < Packet::m_operations[m_operation].minSize) {
+    return Truncated;
+  }
+
+  const char *field = data + Packet::m_opcodeSize;
+  switch (m_operation) {
+    case Packet::DATA:
+      m_payload = datagram.subspan(Packet::m_headerSize);
+      m_number = readShort(field);
+      return Valid;
+    case Packet::ACK:
+      m_number = readShort(field);
+      return Valid;
+    case Packet::ERR: {
+      m_number = readShort(field);
+      // The message is taken even without its terminator.
+      const char *text = data + Packet::m_headerSize;
+      m_first = std::string_view(text, strnlen(text, end - text));
+      return Valid;
+    }
+    case Packet::RRQ:
+    case Packet::WRQ:
+      if (!readString(field, end, m_first) ||
+          !readString(field, end, m_second)) {
+        return Unterminated;
+      }
+      break;
+    default:
+      break;
+  }
+
+  // Options follow the request's mode or the OACK's opcode.
+  const char *options = field;
+  const char *pairsEnd = field;
+  while (field < end) {
+    std::string_view name;
+    std::string_view value;
+    if (!readString(field, end, name)) return Unterminated;
+    if (field == end) break;
+    if (!readString(field, end, value)) return Unterminated;
+    pairsEnd = field;
+  }
+  m_options = OptionList(options, pairsEnd);
+  return Valid;
+}
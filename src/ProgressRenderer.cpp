@@ -0,0 +1,58 @@
+#include <ProgressRenderer.h>
+
+#include <cstdio>
+
+ProgressRenderer::ProgressRenderer(const TransferProgress &progress,
+                                   bool receiving, Output output,
+                                   std::chrono::milliseconds interval)
+    : m_progress(progress),
+      m_receiving(receiving),
+      m_interval(interval),
+      m_output(std::move(output)) {}
+
+ProgressRenderer::~ProgressRenderer() { stop(); }
+
+void ProgressRenderer::start() {
+  if (m_thread.joinable() || !m_output) return;
+  m_start = Clock::now();
+  m_drawnBytes = 0;
+  m_stopping = false;
+  m_thread = std::thread(&ProgressRenderer::run, this);
+}
+
+void ProgressRenderer::stop() {
+  if (!m_thread.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_one();
+  m_thread.join();
+  draw(Clock::now());
+  if (m_drawnBytes > 0) m_output("\n");
+}
+
+void ProgressRenderer::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!m_wake.wait_for(lock, m_interval, [this] { return m_stopping; })) {
+    draw(Clock::now());
+  }
+}
+
+void ProgressRenderer::draw(Clock::time_point now) {
+  const uint64_t bytes = m_progress.bytes.load(std::memory_order_relaxed);
+  if (bytes == m_drawnBytes) return;
+  m_drawnBytes = bytes;
+  const double milliseconds =
+      std::chrono::duration<double, std::milli>(now - m_start).count();
+  const double kbs = milliseconds > 0 ? bytes / milliseconds : 0.0;
+  char line[128];
+  std::snprintf(line, sizeof(line),
+                m_receiving ? "\r%llu bytes (%u blocks) received. Speed "
+                              "%.2lf kb/s."
+                            : "\r%llu bytes (%u blocks) written. Speed "
+                              "%.2lf kb/s.",
+                static_cast<unsigned long long>(bytes),
+                m_progress.blocks.load(std::memory_order_relaxed), kbs);
+  m_output(line);
+}
@@ -0,0 +1,34 @@
+#include <RttEstimator.h>
+
+#include <algorithm>
+
+RttEstimator::RttEstimator() { reset(); }
+
+void RttEstimator::reset() {
+  m_srtt = Duration::zero();
+  m_rttvar = Duration::zero();
+  m_rto = m_initialRto;
+  m_hasSample = false;
+}
+
+void RttEstimator::sample(Duration rtt) {
+  if (!m_hasSample) {
+    m_srtt = rtt;
+    m_rttvar = rtt / 2;
+    m_hasSample = true;
+  } else {
+    const Duration delta = m_srtt > rtt ? m_srtt - rtt : rtt - m_srtt;
+    m_rttvar = (3 * m_rttvar + delta) / 4;
+    m_srtt = (7 * m_srtt + rtt) / 8;
+  }
+  m_rto = estimate();
+}
+
+RttEstimator::Duration RttEstimator::estimate() const {
+  return std::clamp(m_srtt + std::max(m_granularity, 4 * m_rttvar), m_minRto,
+                    m_maxRto);
+}
+
+void RttEstimator::backoff() { m_rto = std::min(m_rto * 2, m_maxRto); }
+
+void RttEstimator::settle() { m_rto = m_hasSample ? estimate() : m_initialRto; }
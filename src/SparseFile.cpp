@@ -0,0 +1,110 @@
+#include <SparseFile.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SPARSE_X86 1
+#endif
+
+namespace {
+
+bool zeroTail(const char *data, size_t size) {
+  uint64_t bits = 0;
+  for (; size >= 8; size -= 8, data += 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    bits |= word;
+  }
+  for (; size > 0; --size, ++data) bits |= static_cast<uint8_t>(*data);
+  return bits == 0;
+}
+
+#if defined(SPARSE_X86)
+// SSE2 is part of x86-64, so this needs no dispatch.
+bool zeroSse2(const char *data, size_t size) {
+  const __m128i zero = _mm_setzero_si128();
+  for (; size >= 64; size -= 64, data += 64) {
+    const __m128i *lanes = reinterpret_cast<const __m128i *>(data);
+    const __m128i bits =
+        _mm_or_si128(_mm_or_si128(_mm_loadu_si128(lanes),
+                                  _mm_loadu_si128(lanes + 1)),
+                     _mm_or_si128(_mm_loadu_si128(lanes + 2),
+                                  _mm_loadu_si128(lanes + 3)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zero)) != 0xffff) {
+      return false;
+    }
+  }
+  return zeroTail(data, size);
+}
+
+__attribute__((target("avx2"))) bool zeroAvx2(const char *data,
+                                              size_t size) {
+  for (; size >= 128; size -= 128, data += 128) {
+    const __m256i *lanes = reinterpret_cast<const __m256i *>(data);
+    const __m256i bits =
+        _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(lanes),
+                                        _mm256_loadu_si256(lanes + 1)),
+                        _mm256_or_si256(_mm256_loadu_si256(lanes + 2),
+                                        _mm256_loadu_si256(lanes + 3)));
+    if (!_mm256_testz_si256(bits, bits)) return false;
+  }
+  return zeroTail(data, size);
+}
+#endif
+
+}  // namespace
+
+bool SparseFile::isZero(const char *data, size_t size) {
+  // Most blocks of ordinary data fail on their first bytes.
+  if (size >= 8 && !zeroTail(data, 8)) return false;
+#if defined(SPARSE_X86)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 ? zeroAvx2(data, size) : zeroSse2(data, size);
+#else
+  return zeroTail(data, size);
+#endif
+}
+
+bool SparseFile::preallocate(int fd, uint64_t size) {
+  m_preallocated =
+      size > 0 && ::fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0;
+  return m_preallocated;
+}
+
+void SparseFile::skip(uint64_t offset, uint64_t size) {
+  m_skipped += size;
+  if (!m_runs.empty() && m_runs.back().second == offset) {
+    m_runs.back().second += size;
+  } else {
+    m_runs.emplace_back(offset, offset + size);
+  }
+}
+
+bool SparseFile::finish(int fd, uint64_t size) {
+  if (!m_preallocated && m_skipped == 0) return true;
+  // Preallocation used the announced size; a trailing zero run was never
+  // written.
+  if (::ftruncate(fd, static_cast<off_t>(size)) == -1) return false;
+  if (!m_preallocated) return true;
+  for (const auto &run : m_runs) {
+    // Partial pages hold data next to the run.
+    const uint64_t start =
+        (run.first + m_pageSize - 1) / m_pageSize * m_pageSize;
+    const uint64_t end = run.second / m_pageSize * m_pageSize;
+    if (end > start) {
+      ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(start), static_cast<off_t>(end - start));
+    }
+  }
+  return true;
+}
+
+void SparseFile::reset() {
+  m_preallocated = false;
+  m_skipped = 0;
+  m_runs.clear();
+}
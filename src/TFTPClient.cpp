@@ -1,354 +1,258 @@
 #include <TFTPClient.h>
 
-TFTPClient::TFTPClient(std::string ip, int port, std::string mode)
-    : m_socket(ip, port),
+#include <strings.h>
+
+#include <cerrno>
+
+TFTPClient::TFTPClient(std::string ip, int port, std::string mode,
+                       std::shared_ptr<AsyncLogger> log)
+    : m_log(log ? std::move(log) : openLog()),
+      m_socket(ip, port),
       m_remoteAddress(ip),
-      m_port(port),
-      m_remotePort(0),
-      m_receivedBlock(0),
-      m_mode(mode) {
+      m_port(port) {
+  m_options.mode = mode;
+}
+
+std::shared_ptr<AsyncLogger> TFTPClient::openLog() {
   ptime nowtime = second_clock::local_time();
   std::string logPath = to_simple_string(nowtime);
   logPath[11] = '-';
   logPath = "logs/" + logPath + ".log";
-  logfile.open(logPath.c_str(),
-               std::fstream::in | std::fstream::out | std::fstream::app);
+  auto log = std::make_shared<AsyncLogger>();
+  log->open(logPath);
+  return log;
 }
 
-void TFTPClient::changeMode(const std::string &mode) { m_mode = mode; }
+void TFTPClient::changeMode(const std::string &mode) { m_options.mode = mode; }
+
+bool TFTPClient::setWindowSize(uint16_t windowSize) {
+  if (windowSize < 1) {
+    return false;
+  }
+  m_options.windowSize = windowSize;
+  return true;
+}
+
+bool TFTPClient::setBackend(Socket::Backend backend) {
+  // Set the ring up here so an unsupported kernel is reported right away.
+  if (!m_socket.SetBackend(backend)) return false;
+  m_options.backend = backend;
+  return true;
+}
+
+bool TFTPClient::setBlockSize(uint16_t blockSize) {
+  if (blockSize < TransferSession::m_minBlockSize ||
+      blockSize > TransferSession::m_maxBlockSize) {
+    return false;
+  }
+  m_options.blockSize = blockSize;
+  return true;
+}
 
 void TFTPClient::writeLog(const std::string Message) {
-  std::string messages = to_simple_string(second_clock::local_time());
-  messages[11] = '-';
-  messages += ":\t" + Message;
-  messages += "\n";
-  logfile.write(messages.c_str(), messages.length());
-  logfile.flush();
+  if (m_log) m_log->log(Message);
 }
 
 std::string TFTPClient::errorDescription(TFTPClient::status code) {
   switch (code) {
     case status::Success:
       return "Success.\n";
-    case InvalidSocket:
+    case status::InvalidSocket:
       return "Error! Invalid Socket.\n";
-    case WriteError:
+    case status::WriteError:
       return "Error! Write Socket.\n";
-    case ReadError:
+    case status::ReadError:
       return "Error! Read Socket.\n";
-    case UnexpectedPacketReceived:
+    case status::UnexpectedPacketReceived:
       return "Error! Unexpected Packet Received.\n";
-    case EmptyFilename:
+    case status::EmptyFilename:
       return "Error! Empty Filename.\n";
-    case OpenFileError:
+    case status::OpenFileError:
       return "Error! Can't Open File.\n";
-    case WriteFileError:
+    case status::WriteFileError:
       return "Error! Write File.\n";
-    case ReadFileError:
+    case status::ReadFileError:
       return "Error! Read File.\n";
-    case TimeOut:
+    case status::TimeOut:
       return "Error! Server Timeout.\n";
+    case status::Cancelled:
+      return "Error! Transfer Cancelled.\n";
+    case status::DigestMismatch:
+      return "Error! Digest Mismatch.\n";
     default:
       return "Error!\n";
   }
 }
 
-TFTPClient::Result TFTPClient::sendRequest(const std::string &fileName,
-                                           OperationCode code) {
-  if (fileName.empty()) {
-    return std::make_pair(status::EmptyFilename, 0);
-  }
-
-  m_buffer[0] = 0;
-  m_buffer[1] = static_cast<char>(code);
+TFTPClient::status TFTPClient::transfer(TransferSession::Direction direction,
+                                        const std::string &remoteFile,
+                                        const std::string &localFile,
+                                        const TransferOptions &options) {
+  const bool isGet = direction == TransferSession::Get;
+  TransferSession session(m_socket, m_remoteAddress, m_port, direction,
+                          remoteFile, localFile, options, m_rtt);
 
-  char *end = std::strncpy(&m_buffer[2], fileName.c_str(), fileName.size()) +
-              fileName.size();
-  *end++ = '\0';
+  TransferProgress progress;
+  session.setProgress(&progress);
+  ProgressRenderer renderer(progress, isGet, m_output);
+  auto now = TransferSession::Clock::now();
+  const auto startTime = now;
+  m_lastBytes = 0;
+  if (m_verbose) renderer.start();
+  if (session.start(now) == status::OpenFileError) {
+    renderer.stop();
+    m_lastStats = session.stats();
+    this->writeLog("Error! Can't open file!\n");
+    print("Error! Can't open file!\n\n");
+    return status::OpenFileError;
+  }
 
-  end = std::strncpy(end, m_mode.c_str(), m_mode.size()) + m_mode.size();
-  *end++ = '\0';
+  while (!session.finished()) {
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+        session.deadline() - now);
+    const int ready =
+        m_socket.WaitForRead(static_cast<int>(std::max<long>(wait.count(), 0)));
+    now = TransferSession::Clock::now();
+    if (ready != 0) {
+      session.onReadable(now);
+    } else if (session.onTimeout(now)) {
+      this->writeLog("Error! Timeout!\n");
+      print("Error! Timeout!\n\n");
+    }
+  }
+  renderer.stop();
+  // The next transfer starts from the estimate, not from this one's
+  // backoff.
+  m_rtt = session.rtt();
+  m_rtt.settle();
+  m_blockSize = session.blockSize();
+  m_windowSize = session.windowSize();
+  m_lastBytes = session.transferredBytes();
+  m_lastStats = session.stats();
 
-  const auto packetSize = std::distance(&m_buffer[0], end);
-  const auto sendNums = m_socket.SendTo(&m_buffer[0], packetSize,
-                                        m_remoteAddress.c_str(), m_port);
-  if (sendNums != packetSize) {
-    return std::make_pair(status::WriteError, sendNums);
+  if (!session.errorMessage().empty()) {
+    std::string errorMessage = "\nError! " + session.errorMessage() + "\n";
+    this->writeLog(errorMessage);
+    print(errorMessage + "\n");
   }
-  return std::make_pair(status::Success, sendNums);
+  if (session.result() == status::Success) {
+    report(isGet, session.transferredBytes(), session.losePercent(),
+           startTime);
+    if (!m_lastStats.digest.empty()) {
+      const std::string digestMessage = m_lastStats.digest + "\n";
+      this->writeLog(digestMessage);
+      print(digestMessage);
+    }
+  }
+  return session.result();
 }
 
-TFTPClient::Result TFTPClient::sendAck() {
-  const size_t packetSize = 4;
-  m_buffer[0] = 0;
-  m_buffer[1] = static_cast<char>(OperationCode::ACK);
-
-  const auto sendNums = m_socket.SendTo(&m_buffer[0], packetSize,
-                                        m_remoteAddress.c_str(), m_remotePort);
-  const bool isSuccess = sendNums == packetSize;
-  return std::make_pair(isSuccess ? status::Success : status::WriteError,
-                        sendNums);
+void TFTPClient::report(bool isGet, uint64_t bytes, double losePercent,
+                        TransferSession::Clock::time_point startTime) {
+  const double milliseconds = std::chrono::duration<double, std::milli>(
+                                  TransferSession::Clock::now() - startTime)
+                                  .count();
+  const double kbs = bytes / milliseconds;
+  std::string successMessage =
+      (format(isGet ? "\n%d bytes received! Speed %.2lf kb/s.\nGet file "
+                      "successfully! (%%%.1lf lose)\n"
+                    : "\n%d bytes sent! Speed %.2lf kb/s.\nPut file "
+                      "successfully! (%%%.1lf lose)\n") %
+       bytes % kbs % losePercent)
+          .str();
+  this->writeLog(successMessage);
+  print(successMessage);
 }
 
-TFTPClient::Result TFTPClient::read() {
-  std::string errorMessage;
-  const auto recvNums = m_socket.RecvFrom(&m_buffer[0], m_buffer.size(),
-                                          &m_remoteAddress[0], &m_remotePort);
-  if (recvNums == -1) {
-    this->writeLog("Error! Timeout!\n");
-    std::puts("Error! Timeout!\n");
-    return std::make_pair(status::TimeOut, recvNums);
+TFTPClient::status TFTPClient::getMulticast(const std::string &remoteFile,
+                                            const std::string &localFile) {
+  if (strcasecmp(m_options.mode.c_str(), "octet") != 0) {
+    return get(remoteFile, localFile);
   }
-  const auto code = static_cast<OperationCode>(m_buffer[1]);
-  switch (code) {
-    case OperationCode::DATA:
-      m_receivedBlock = ((uint8_t)m_buffer[2] << 8) | (uint8_t)m_buffer[3];
-      return std::make_pair(status::Success, recvNums - m_headerSize);
-    case OperationCode::ACK:
-      m_receivedBlock = ((uint8_t)m_buffer[2] << 8) | (uint8_t)m_buffer[3];
-      return std::make_pair(status::Success, m_receivedBlock);
-    case OperationCode::ERR:
-      errorMessage =
-          (format("\nError! Message from remote host: %s.\n") % &m_buffer[4])
-              .str();
-      this->writeLog(errorMessage);
-      std::cout << errorMessage << std::endl;
-      return std::make_pair(status::ReadError, recvNums);
-    default:
-      errorMessage =
-          (format("\nError! Unexpected packet received! Type: %i.\n") % code)
-              .str();
-      this->writeLog(errorMessage);
-      std::cout << errorMessage << std::endl;
-      return std::make_pair(status::UnexpectedPacketReceived, recvNums);
+  MulticastSession session(m_socket, m_remoteAddress, m_port, remoteFile,
+                           localFile, m_options, m_rtt);
+  auto now = TransferSession::Clock::now();
+  const auto startTime = now;
+  m_lastBytes = 0;
+  if (session.start(now) == status::OpenFileError) {
+    m_lastStats = session.stats();
+    this->writeLog("Error! Can't open file!\n");
+    print("Error! Can't open file!\n\n");
+    return status::OpenFileError;
   }
-}
 
-TFTPClient::Result TFTPClient::getFile(std::fstream &file,
-                                       const ptime &startime, double &loseper) {
-  uint16_t totalRecvBlocks = 0;
-  uint16_t recvNums = 0;
-  unsigned int totalRecvNums = 0;
-  Result result;
-  int losetimes = 0;
-  int recvt = 0, loset = 0;
-  while (true) {
-    result = this->read();
-    recvt++;
-    if (result.first != status::Success) {
-      losetimes++;
-      loset++;
-      if (losetimes > 3)
-        return std::make_pair(result.first,
-                              totalRecvNums + std::max(result.second, 0));
-      continue;
-    }
-    losetimes = 0;
-    recvNums = result.second;
-    if ((recvNums > 0) && (m_receivedBlock > totalRecvBlocks) ||
-        totalRecvBlocks == 65535) {
-      ++totalRecvBlocks;
-      totalRecvNums += recvNums;
-      file.write(&m_buffer[m_headerSize], recvNums);
-      if (file.bad()) {
-        return std::make_pair(status::WriteFileError, totalRecvNums);
-      }
-      result = this->sendAck();
-      recvt++;
-    } else if (m_receivedBlock == totalRecvBlocks) {
-      loset++;
-      recvt++;
-      result = this->sendAck();
-      if (result.first != status::Success) {
-        losetimes = 1;
-        while (losetimes++ < 3) {
-          result = this->sendAck();
-          if (result.first == status::Success) {
-            break;
-          }
-        }
-        recvt += losetimes;
-        loset += losetimes;
-        if (losetimes == 3) {
-          return std::make_pair(result.first, totalRecvNums);
-        }
-      }
+  while (!session.finished()) {
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+        session.deadline() - now);
+    struct pollfd fds[2] = {{m_socket.GetDescriptor(), POLLIN, 0},
+                            {session.groupDescriptor(), POLLIN, 0}};
+    int ready;
+    do {
+      ready = ::poll(fds, fds[1].fd == -1 ? 1 : 2,
+                     static_cast<int>(std::max<long>(wait.count(), 0)));
+    } while (ready == -1 && errno == EINTR);
+    now = TransferSession::Clock::now();
+    if (ready > 0) {
+      session.onReadable(now);
+    } else if (session.onTimeout(now) && session.master()) {
+      this->writeLog("Error! Timeout!\n");
+      print("Error! Timeout!\n\n");
     }
-
-    ptime now = microsec_clock::local_time();
-    time_duration dur = now - startime;
-    long long nanoseconds = dur.total_nanoseconds();
-    double kbs = 1000000.0 * totalRecvNums;
-    kbs /= (nanoseconds * 1.0);
-    printf("%u bytes (%i blocks) received. speed %.2lf kb/s.\n", totalRecvNums,
-           totalRecvBlocks, kbs);
-
-    if (recvNums != m_dataSize) break;
   }
-  loseper = (loset * 100.0) / (recvt * 1.0);
-  return std::make_pair(status::Success, totalRecvNums);
-}
-
-TFTPClient::Result TFTPClient::putFile(std::fstream &file,
-                                       const ptime &starttime,
-                                       double &loseper) {
-  Result result;
-  uint16_t currentBlock = 0;
-  unsigned int totalSendNums = 0;
-  Buffer backs;
-  int losetimes = 0, loses = 0;
-  int recvt = 0, loset = 0;
-  while (true) {
-    if (currentBlock == m_receivedBlock) {
-      if (file.eof()) {
-        loseper = (100.0 * loset) / (1.0 * recvt);
-        return std::make_pair(status::Success, totalSendNums);
-      }
-      loses = 0;
-      ++currentBlock;
-      m_buffer[0] = 0;
-      m_buffer[1] = static_cast<char>(OperationCode::DATA);
-      m_buffer[2] = static_cast<uint8_t>(currentBlock >> 8);
-      m_buffer[3] = static_cast<uint8_t>(currentBlock & 0xff);
-      file.read(&m_buffer[m_headerSize], m_dataSize);
-      if (file.bad()) {
-        return std::make_pair(status::ReadFileError, totalSendNums);
-      }
-      memcpy(&backs[0], &m_buffer[0], m_headerSize + m_dataSize);
-    } else {
-      loses++;
-      loset++;
-      if (loses == 3) {
-        return std::make_pair(result.first, totalSendNums);
-      }
-      memcpy(&m_buffer[0], &backs[0], m_headerSize + m_dataSize);
-    }
-    const auto packetSize = m_headerSize + file.gcount();
-    const auto sendNums = m_socket.SendTo(
-        &m_buffer[0], packetSize, m_remoteAddress.c_str(), m_remotePort);
-    recvt++;
-    if (sendNums != packetSize) {
-      return std::make_pair(status::WriteError, totalSendNums + sendNums);
-    }
-
-    result = this->read();
-    recvt++;
-    if (result.first != status::Success || m_receivedBlock != currentBlock) {
-      loset++;
-      result = this->read();
-      if (result.first != status::Success) {
-        losetimes = 1;
-        while (losetimes++ < 3) {
-          result = this->read();
-          if (result.first == status::Success) {
-            break;
-          }
-        }
-        recvt += losetimes;
-        loset += losetimes;
-      }
-    }
-
-    totalSendNums += file.gcount();
+  // The next transfer starts from the estimate, not from this one's
+  // backoff.
+  m_rtt = session.rtt();
+  m_rtt.settle();
+  m_blockSize = session.blockSize();
+  m_lastBytes = session.transferredBytes();
+  m_lastStats = session.stats();
 
-    ptime now = microsec_clock::local_time();
-    time_duration dur = now - starttime;
-    long long nanoseconds = dur.total_nanoseconds();
-    double kbs = 1000000.0 * totalSendNums;
-    kbs /= (nanoseconds * 1.0);
-    printf("%u bytes (%i blocks) written. Speed %.2lf kb/s.\n", totalSendNums,
-           currentBlock, kbs);
+  if (session.declined()) {
+    print("Server doesn't offer multicast, getting " + remoteFile +
+          " by unicast.\n");
+    return get(remoteFile, localFile);
   }
-  loseper = (100.0 * loset) / (1.0 * recvt);
-  return std::make_pair(status::Success, totalSendNums);
+  if (!session.errorMessage().empty()) {
+    std::string errorMessage = "\nError! " + session.errorMessage() + "\n";
+    this->writeLog(errorMessage);
+    print(errorMessage + "\n");
+  }
+  if (session.result() == status::Success) {
+    report(true, session.transferredBytes(), 0.0, startTime);
+  }
+  return session.result();
 }
 
 TFTPClient::status TFTPClient::get(const std::string &fileName) {
-  double loset = 0;
-  std::fstream file;
-  if (m_mode == "netascii") {
-    file.open(fileName.c_str(), std::ios_base::out);
-  } else if (m_mode == "octet") {
-    file.open(fileName.c_str(), std::ios_base::out | std::ios_base::binary);
-  }
-  if (!file.is_open()) {
-    this->writeLog("Error! Can't open file!\n");
-    std::puts("Error! Can't open file!\n");
-    file.close();
-    return status::OpenFileError;
-  }
+  return this->transfer(TransferSession::Get, fileName, fileName, m_options);
+}
 
-  ptime startTime = microsec_clock::local_time();
-  Result result = this->sendRequest(fileName, OperationCode::RRQ);
-  if (result.first != status::Success) {
-    file.close();
-    return result.first;
-  }
+TFTPClient::status TFTPClient::get(const std::string &remoteFile,
+                                   const std::string &localFile) {
+  return this->transfer(TransferSession::Get, remoteFile, localFile,
+                        m_options);
+}
 
-  m_receivedBlock = 0;
-  result = this->getFile(file, startTime, loset);
-  if (result.first == status::Success) {
-    ptime now = microsec_clock::local_time();
-    time_duration dur = now - startTime;
-    long long nanoseconds = dur.total_nanoseconds();
-    double kbs = 1000000.0 * result.second;
-    kbs /= (nanoseconds * 1.0);
-    std::string successMessage =
-        (format("\n%d bytes received! Speed %.2lf kb/s.\nGet file "
-                "successfully! (%%%.1lf lose)\n") %
-         result.second % kbs % loset)
-            .str();
-    this->writeLog(successMessage);
-    std::cout << successMessage;
-  }
-  file.close();
-  return result.first;
+TFTPClient::status TFTPClient::get(const std::string &remoteFile,
+                                   std::shared_ptr<DataSink> sink) {
+  TransferOptions options = m_options;
+  options.sink = std::move(sink);
+  return this->transfer(TransferSession::Get, remoteFile, "", options);
 }
 
 TFTPClient::status TFTPClient::put(const std::string &fileName) {
-  double loset = 0;
-  std::fstream file;
-  if (m_mode == "netascii") {
-    file.open(fileName.c_str(), std::ios_base::in);
-  } else if (m_mode == "octet") {
-    file.open(fileName.c_str(), std::ios_base::in | std::ios_base::binary);
-  }
-  if (!file) {
-    this->writeLog("Error! Can't open file!\n");
-    std::puts("Error! Can't open file!\n");
-    file.close();
-    return status::OpenFileError;
-  }
-
-  ptime startTime = microsec_clock::local_time();
-  Result result = this->sendRequest(fileName, OperationCode::WRQ);
-  if (result.first != status::Success) {
-    file.close();
-    return result.first;
-  }
+  return this->transfer(TransferSession::Put, fileName, fileName, m_options);
+}
 
-  m_receivedBlock = 0;
-  result = this->read();
-  if (result.first != status::Success) {
-    file.close();
-    return result.first;
-  }
+TFTPClient::status TFTPClient::put(const std::string &localFile,
+                                   const std::string &remoteFile) {
+  return this->transfer(TransferSession::Put, remoteFile, localFile,
+                        m_options);
+}
 
-  result = this->putFile(file, startTime, loset);
-  if (result.first == status::Success) {
-    ptime now = microsec_clock::local_time();
-    time_duration dur = now - startTime;
-    long long nanoseconds = dur.total_nanoseconds();
-    double kbs = 1000000.0 * result.second;
-    kbs /= (nanoseconds * 1.0);
-    std::string successMessage =
-        (format("\n%d bytes sent! Speed %.2lf kb/s.\nPut file successfully! "
-                "(%%%.1lf lose)\n") %
-         result.second % kbs % loset)
-            .str();
-    this->writeLog(successMessage);
-    std::cout << successMessage;
-  }
-  file.close();
-  return result.first;
-}
\ No newline at end of file
+TFTPClient::status TFTPClient::put(std::shared_ptr<DataSource> source,
+                                   const std::string &remoteFile) {
+  TransferOptions options = m_options;
+  options.source = std::move(source);
+  return this->transfer(TransferSession::Put, remoteFile, "", options);
+}
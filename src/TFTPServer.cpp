@@ -0,0 +1,326 @@
+#include <FileCache.h>
+#include <TFTPServer.h>
+#include <TransferEngine.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+
+class TFTPServer::Worker {
+ public:
+  Worker(const ServerOptions &options, size_t index)
+      : m_options(options), m_index(index), m_cache(options.cacheBytes) {
+    char root[PATH_MAX];
+    if (::realpath(options.root.c_str(), root) != nullptr) m_root = root;
+  }
+
+  bool open(const Endpoint &local);
+  void start();
+  void stop();
+  Totals totals() const;
+
+ private:
+  static constexpr size_t m_maxRequest = 1024;
+
+  void run();
+  void onRequest();
+  void handleRequest(const char *packet, size_t size, const Endpoint &client);
+  bool resolve(const std::string &name, bool create, std::string &path,
+               uint16_t &error) const;
+  void reject(const Endpoint &client, uint16_t code, const std::string &text);
+  void finish(const std::string &key, const TransferSession &session,
+              const std::string &path, const std::string &upload);
+
+  const ServerOptions &m_options;
+  size_t m_index;
+  // The root with symlinks and dots resolved; empty when it doesn't exist.
+  std::string m_root;
+  std::unique_ptr<UDPSocket> m_listener;
+  TransferEngine m_engine;
+  FileCache m_cache;
+  // Running transfers by client address and port: a repeated request must
+  // not start a second transfer.
+  std::unordered_map<std::string, TransferEngine::Id> m_clients;
+  uint64_t m_uploads = 0;
+  bool m_running = true;
+  Totals m_totals;
+  std::thread m_thread;
+};
+
+bool TFTPServer::Worker::open(const Endpoint &local) {
+  if (m_root.empty()) return false;
+  m_listener.reset(new UDPSocket(local.family()));
+  if (m_listener->GetDescriptor() == -1 || !m_listener->Bind(local, true)) {
+    return false;
+  }
+  m_engine.watch(m_listener->GetDescriptor(), [this]() { onRequest(); });
+  return true;
+}
+
+void TFTPServer::Worker::start() {
+  m_thread = std::thread(&Worker::run, this);
+  // One worker per core keeps a client's packets on the same cache lines.
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(m_index % cores, &cpus);
+  pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus);
+}
+
+void TFTPServer::Worker::stop() {
+  if (!m_thread.joinable()) return;
+  m_engine.post([this]() {
+    std::vector<TransferEngine::Id> running;
+    for (const auto &client : m_clients) running.push_back(client.second);
+    for (TransferEngine::Id id : running) {
+      m_engine.cancel(id, TransferSession::Cancelled);
+    }
+    m_running = false;
+  });
+  m_thread.join();
+}
+
+TFTPServer::Totals TFTPServer::Worker::totals() const {
+  Totals totals = m_totals;
+  totals.cacheHits = m_cache.hits();
+  totals.cacheMisses = m_cache.misses();
+  return totals;
+}
+
+void TFTPServer::Worker::run() {
+  while (m_running) m_engine.poll();
+}
+
+void TFTPServer::Worker::onRequest() {
+  char packet[m_maxRequest];
+  Endpoint client;
+  int size;
+  while ((size = m_listener->RecvFrom(packet, m_maxRequest, &client)) >= 0) {
+    handleRequest(packet, static_cast<size_t>(size), client);
+  }
+}
+
+void TFTPServer::Worker::handleRequest(const char *packet, size_t size,
+                                       const Endpoint &client) {
+  // Filename, mode, then option and value pairs, all NUL terminated.
+  PacketView request;
+  const PacketView::Result parsed = request.parse({packet, size});
+  if (parsed == PacketView::Truncated) return;
+  const uint16_t code = request.operation();
+  if (parsed != PacketView::Valid ||
+      (code != Packet::RRQ && code != Packet::WRQ) ||
+      request.file().empty()) {
+    reject(client, 4, "Illegal TFTP operation");
+    return;
+  }
+  const std::string key(reinterpret_cast<const char *>(client.address()),
+                        client.length());
+  // The client repeated a request we are already answering.
+  if (m_clients.count(key) != 0) return;
+
+  std::string mode(request.mode());
+  std::transform(mode.begin(), mode.end(), mode.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (mode != "octet" && mode != "netascii") {
+    reject(client, 0, "Unsupported mode");
+    return;
+  }
+
+  // Names are relative to the root and must not climb out of it.
+  const std::string file(request.file());
+  std::string name = file;
+  name.erase(0, name.find_first_not_of('/'));
+  if (name.empty() || (code == Packet::WRQ && !m_options.allowWrite)) {
+    reject(client, 2, "Access violation");
+    return;
+  }
+  std::string path;
+  uint16_t error = 0;
+  if (!resolve(name, code == Packet::WRQ, path, error)) {
+    reject(client, error,
+           error == 1 ? "File not found" : "Access violation");
+    return;
+  }
+
+  uint16_t blockSize = TransferSession::m_defaultBlockSize;
+  uint16_t windowSize = 1;
+  bool blockSizeAsked = false;
+  bool windowSizeAsked = false;
+  bool transferSizeAsked = false;
+  for (const Packet::Option &option : request.options()) {
+    uint64_t value = 0;
+    if (!Packet::parseNumber(option.value, value)) continue;
+    if (Packet::sameName(option.name, "blksize") &&
+        value >= TransferSession::m_minBlockSize) {
+      blockSize = static_cast<uint16_t>(
+          std::min<uint64_t>(value, m_options.maxBlockSize));
+      blockSizeAsked = true;
+    } else if (Packet::sameName(option.name, "windowsize") && value >= 1) {
+      windowSize = static_cast<uint16_t>(
+          std::min<uint64_t>(value, m_options.maxWindowSize));
+      windowSizeAsked = true;
+    } else if (Packet::sameName(option.name, "tsize")) {
+      transferSizeAsked = true;
+    }
+  }
+  // RFC 2349: an octet RRQ learns the file's size so it can reserve it.
+  struct stat info;
+  transferSizeAsked = transferSizeAsked && code == Packet::RRQ &&
+                      mode == "octet" && ::stat(path.c_str(), &info) == 0 &&
+                      S_ISREG(info.st_mode);
+  const Packet::Number blockSizeText(blockSize);
+  const Packet::Number windowSizeText(windowSize);
+  const Packet::Number transferSizeText(
+      transferSizeAsked ? static_cast<uint64_t>(info.st_size) : 0);
+  Packet::Option acknowledged[3];
+  size_t count = 0;
+  if (blockSizeAsked) acknowledged[count++] = {"blksize", blockSizeText.view()};
+  if (windowSizeAsked) {
+    acknowledged[count++] = {"windowsize", windowSizeText.view()};
+  }
+  if (transferSizeAsked) {
+    acknowledged[count++] = {"tsize", transferSizeText.view()};
+  }
+  std::string optionAck;
+  if (count > 0) {
+    const std::span<const Packet::Option> options(acknowledged, count);
+    optionAck.resize(Packet::m_opcodeSize + Packet::optionsSize(options));
+    Packet::optionAck(optionAck, options);
+  }
+
+  // Uploads land in a private file that replaces the target only once
+  // complete, so mappings of the old file serving RRQs stay intact.
+  const bool serve = code == Packet::RRQ;
+  const std::string upload =
+      serve ? std::string()
+            : path + ".tftp-" + std::to_string(m_index) + "-" +
+                  std::to_string(++m_uploads);
+  TransferOptions options;
+  options.mode = mode;
+  // A writer thread per upload would not scale to thousands of clients.
+  options.writeBehind = false;
+  FileCache::Mapping source;
+  if (serve && mode == "octet") source = m_cache.get(path);
+
+  auto socket = std::make_unique<UDPClient>(client);
+  auto session = std::make_unique<TransferSession>(
+      *socket, client.host(), client.port(),
+      serve ? TransferSession::Put : TransferSession::Get, file,
+      serve ? path : upload, options);
+  session->accept(TransferSession::Clock::now(), client, blockSize,
+                  windowSize, optionAck, std::move(source));
+  // adopt() reports a transfer that failed right away before returning.
+  m_clients[key] = 0;
+  const TransferEngine::Id id = m_engine.adopt(
+      std::move(socket), std::move(session),
+      [this, key, path, upload](TransferEngine::Id,
+                                const TransferSession &finished) {
+        finish(key, finished, path, upload);
+      });
+  auto running = m_clients.find(key);
+  if (running != m_clients.end()) running->second = id;
+}
+
+// `name` under the root with every symlink and dot resolved, so neither
+// ".." nor a link can lead out of it. An upload's file may not exist
+// yet; then its directory is resolved instead.
+bool TFTPServer::Worker::resolve(const std::string &name, bool create,
+                                 std::string &path, uint16_t &error) const {
+  // Refused before looking, so the answer doesn't tell whether files
+  // outside the root exist.
+  const std::filesystem::path normal =
+      std::filesystem::path(name).lexically_normal();
+  if (!normal.empty() && *normal.begin() == "..") {
+    error = 2;
+    return false;
+  }
+  const std::string full = m_root + "/" + name;
+  char resolved[PATH_MAX];
+  std::string directory;
+  if (::realpath(full.c_str(), resolved) != nullptr) {
+    path = resolved;
+    directory = path;
+  } else {
+    const size_t slash = full.rfind('/');
+    const std::string base = full.substr(slash + 1);
+    if (!create || errno != ENOENT || base.empty() || base == "." ||
+        base == ".." ||
+        ::realpath(full.substr(0, slash).c_str(), resolved) == nullptr) {
+      error = errno == ENOENT ? 1 : 2;
+      return false;
+    }
+    directory = resolved;
+    path = directory + "/" + base;
+  }
+  error = 2;
+  const std::string prefix = m_root == "/" ? m_root : m_root + "/";
+  return directory == m_root ||
+         directory.compare(0, prefix.size(), prefix) == 0;
+}
+
+void TFTPServer::Worker::reject(const Endpoint &client, uint16_t code,
+                                const std::string &text) {
+  char packet[m_maxRequest];
+  m_listener->SendTo(packet, Packet::error(packet, code, text), &client);
+}
+
+void TFTPServer::Worker::finish(const std::string &key,
+                                const TransferSession &session,
+                                const std::string &path,
+                                const std::string &upload) {
+  m_clients.erase(key);
+  ++m_totals.transfers;
+  m_totals.bytes += session.transferredBytes();
+  const bool succeeded = session.result() == TransferSession::Success;
+  if (!succeeded) ++m_totals.failed;
+  if (upload.empty()) return;
+  if (!succeeded || std::rename(upload.c_str(), path.c_str()) != 0) {
+    std::remove(upload.c_str());
+  }
+}
+
+TFTPServer::TFTPServer(const ServerOptions &options) : m_options(options) {}
+
+TFTPServer::~TFTPServer() { stop(); }
+
+bool TFTPServer::start() {
+  Endpoint local;
+  if (!local.resolve(m_options.address, m_options.port)) return false;
+  const size_t count = std::max<size_t>(1, m_options.workers);
+  for (size_t i = 0; i < count; ++i) {
+    m_workers.emplace_back(new Worker(m_options, i));
+    if (!m_workers.back()->open(local)) {
+      m_workers.clear();
+      return false;
+    }
+  }
+  for (auto &worker : m_workers) worker->start();
+  return true;
+}
+
+void TFTPServer::stop() {
+  for (auto &worker : m_workers) worker->stop();
+}
+
+TFTPServer::Totals TFTPServer::totals() const {
+  Totals totals;
+  for (const auto &worker : m_workers) {
+    const Totals part = worker->totals();
+    totals.transfers += part.transfers;
+    totals.failed += part.failed;
+    totals.bytes += part.bytes;
+    totals.cacheHits += part.cacheHits;
+    totals.cacheMisses += part.cacheMisses;
+  }
+  return totals;
+}
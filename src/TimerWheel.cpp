@@ -0,0 +1,48 @@
+#include <TimerWheel.h>
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::duration tick, size_t slots)
+    : m_tick(tick), m_origin(Clock::now()), m_slots(slots) {}
+
+uint64_t TimerWheel::toTick(Clock::time_point when, bool roundUp) const {
+  if (when <= m_origin) return 0;
+  const auto elapsed = (when - m_origin).count();
+  const auto tick = m_tick.count();
+  return static_cast<uint64_t>(roundUp ? (elapsed + tick - 1) / tick
+                                       : elapsed / tick);
+}
+
+void TimerWheel::schedule(uint64_t id, Clock::time_point when) {
+  const uint64_t tick = std::max(toTick(when, true), m_current);
+  auto scheduled = m_scheduled.find(id);
+  if (scheduled != m_scheduled.end()) {
+    // An earlier entry fires first and the owner re-arms it from there.
+    if (scheduled->second <= tick) return;
+    scheduled->second = tick;
+  } else {
+    m_scheduled.emplace(id, tick);
+  }
+  m_slots[tick % m_slots.size()].emplace_back(id, tick);
+}
+
+void TimerWheel::cancel(uint64_t id) { m_scheduled.erase(id); }
+
+TimerWheel::Clock::duration TimerWheel::untilNext(
+    Clock::time_point now) const {
+  // A slot also holds entries of later turns and stale ones left behind by
+  // rescheduling; only a live entry for the slot's own tick counts.
+  uint64_t next = m_current + m_slots.size();
+  for (uint64_t tick = m_current; tick < next; ++tick) {
+    for (const Entry &entry : m_slots[tick % m_slots.size()]) {
+      const auto live = m_scheduled.find(entry.first);
+      if (entry.second == tick && live != m_scheduled.end() &&
+          live->second == tick) {
+        next = tick;
+        break;
+      }
+    }
+  }
+  const Clock::time_point due = m_origin + m_tick * next;
+  return due > now ? due - now : Clock::duration::zero();
+}
@@ -0,0 +1,29 @@
+#include <TokenBucket.h>
+
+#include <algorithm>
+
+void TokenBucket::setRate(uint64_t bytesPerSecond, uint64_t burst) {
+  if (m_rate == 0) m_tokens = static_cast<double>(burst);
+  m_rate = bytesPerSecond;
+  m_burst = static_cast<double>(burst);
+}
+
+TokenBucket::Clock::duration TokenBucket::reserve(uint64_t bytes,
+                                                  Clock::time_point now) {
+  if (m_rate == 0) return Clock::duration::zero();
+  if (now > m_updated) {
+    const double elapsed =
+        std::chrono::duration<double>(now - m_updated).count();
+    m_tokens = std::min(m_burst, m_tokens + elapsed * m_rate);
+    m_updated = now;
+  }
+  // A packet larger than the burst still goes once the bucket is full.
+  const double needed = std::min(static_cast<double>(bytes), m_burst);
+  if (m_tokens >= needed) {
+    m_tokens -= static_cast<double>(bytes);
+    return Clock::duration::zero();
+  }
+  const double seconds = (needed - m_tokens) / m_rate;
+  return std::chrono::ceil<Clock::duration>(
+      std::chrono::duration<double>(seconds));
+}
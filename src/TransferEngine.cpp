@@ -0,0 +1,167 @@
+#include <TransferEngine.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+TransferEngine::TransferEngine()
+    : m_epoll(::epoll_create1(EPOLL_CLOEXEC)),
+      m_wakeup(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = m_wakeupId;
+  ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event);
+}
+
+TransferEngine::~TransferEngine() {
+  if (m_wakeup != -1) ::close(m_wakeup);
+  if (m_epoll != -1) ::close(m_epoll);
+}
+
+TransferEngine::Id TransferEngine::submit(
+    TransferSession::Direction direction, const std::string &ip, uint16_t port,
+    const std::string &remoteFile, const std::string &localFile,
+    const TransferOptions &options, Completion done) {
+  std::unique_ptr<UDPClient> socket =
+      m_socketFactory ? m_socketFactory(ip, port)
+                      : std::make_unique<UDPClient>(ip, port);
+  auto session = std::make_unique<TransferSession>(
+      *socket, ip, port, direction, remoteFile, localFile, options);
+  session->start(TransferSession::Clock::now());
+  return adopt(std::move(socket), std::move(session), std::move(done));
+}
+
+TransferEngine::Id TransferEngine::adopt(
+    std::unique_ptr<UDPClient> socket,
+    std::unique_ptr<TransferSession> session, Completion done) {
+  const Id id = m_nextId++;
+  Entry entry;
+  entry.socket = std::move(socket);
+  entry.session = std::move(session);
+  entry.done = std::move(done);
+  if (!entry.session->finished()) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    if (::epoll_ctl(m_epoll, EPOLL_CTL_ADD, entry.socket->GetDescriptor(),
+                    &event) == -1) {
+      entry.session->cancel(TransferSession::InvalidSocket);
+    }
+  }
+  auto inserted = m_sessions.emplace(id, std::move(entry)).first;
+  settle(id, inserted->second);
+  return id;
+}
+
+void TransferEngine::settle(Id id, Entry &entry) {
+  if (!entry.session->finished()) {
+    m_timers.schedule(id, entry.session->deadline());
+    return;
+  }
+  m_timers.cancel(id);
+  ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, entry.socket->GetDescriptor(), nullptr);
+  Entry finished = std::move(entry);
+  m_sessions.erase(id);
+  if (finished.done) finished.done(id, *finished.session);
+}
+
+void TransferEngine::cancel(Id id, TransferSession::status code) {
+  auto found = m_sessions.find(id);
+  if (found == m_sessions.end()) return;
+  found->second.session->cancel(code);
+  settle(id, found->second);
+}
+
+TransferEngine::Id TransferEngine::watch(int fd, Task onReadable) {
+  const Id id = m_nextId++;
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = id;
+  ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event);
+  m_watches.emplace(id, std::make_pair(fd, std::move(onReadable)));
+  return id;
+}
+
+void TransferEngine::unwatch(Id id) {
+  auto found = m_watches.find(id);
+  if (found == m_watches.end()) return;
+  ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, found->second.first, nullptr);
+  m_watches.erase(found);
+}
+
+void TransferEngine::post(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(m_postMutex);
+    m_posted.push_back(std::move(task));
+  }
+  const uint64_t one = 1;
+  ssize_t written = ::write(m_wakeup, &one, sizeof(one));
+  (void)written;
+}
+
+void TransferEngine::runPosted() {
+  uint64_t count;
+  ssize_t drained = ::read(m_wakeup, &count, sizeof(count));
+  (void)drained;
+  std::vector<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(m_postMutex);
+    tasks.swap(m_posted);
+  }
+  for (Task &task : tasks) task();
+}
+
+bool TransferEngine::poll(int timeoutMs) {
+  if (m_sessions.empty() && m_watches.empty() && timeoutMs < 0) {
+    runPosted();
+    return !m_sessions.empty();
+  }
+
+  if (!m_timers.empty()) {
+    // Sleep until the earliest deadline, but at least a tick: the wheel
+    // can't fire anything sooner.
+    using std::chrono::milliseconds;
+    const long tickMs = std::max<long>(
+        std::chrono::ceil<milliseconds>(m_timers.tick()).count(), 1);
+    const long nextMs = std::chrono::ceil<milliseconds>(
+                            m_timers.untilNext(TransferSession::Clock::now()))
+                            .count();
+    const int waitMs = static_cast<int>(std::max(nextMs, tickMs));
+    timeoutMs = timeoutMs < 0 ? waitMs : std::min(timeoutMs, waitMs);
+  }
+
+  struct epoll_event events[m_maxEvents];
+  const int ready = ::epoll_wait(m_epoll, events, m_maxEvents, timeoutMs);
+  const auto now = TransferSession::Clock::now();
+  for (int i = 0; i < ready; ++i) {
+    const Id id = events[i].data.u64;
+    if (id == m_wakeupId) {
+      runPosted();
+      continue;
+    }
+    auto watched = m_watches.find(id);
+    if (watched != m_watches.end()) {
+      watched->second.second();
+      continue;
+    }
+    auto found = m_sessions.find(id);
+    if (found == m_sessions.end()) continue;
+    found->second.session->onReadable(now);
+    settle(id, found->second);
+  }
+
+  m_timers.advance(now, [this, now](Id id) {
+    auto found = m_sessions.find(id);
+    if (found == m_sessions.end()) return;
+    found->second.session->onTimeout(now);
+    settle(id, found->second);
+  });
+  return !m_sessions.empty();
+}
+
+void TransferEngine::run() {
+  while (this->poll()) {
+  }
+}
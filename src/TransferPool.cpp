@@ -0,0 +1,87 @@
+#include <TFTPClient.h>
+#include <TransferPool.h>
+
+#include <algorithm>
+
+TransferPool::TransferPool(const std::string &ip, uint16_t port,
+                           size_t workers, Report report,
+                           std::shared_ptr<AsyncLogger> log)
+    : m_remoteAddress(ip),
+      m_port(port),
+      m_report(std::move(report)),
+      m_log(log ? std::move(log) : TFTPClient::openLog()) {
+  for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i) {
+    m_workers.emplace_back(&TransferPool::work, this);
+  }
+}
+
+TransferPool::~TransferPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queued.notify_all();
+  for (auto &worker : m_workers) worker.join();
+}
+
+void TransferPool::submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_started) {
+      m_started = true;
+      m_startTime = std::chrono::steady_clock::now();
+    }
+    m_tasks.push_back(std::move(task));
+  }
+  m_queued.notify_one();
+}
+
+TransferPool::Summary TransferPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return m_tasks.empty() && m_running == 0; });
+  Summary summary = m_summary;
+  if (m_started) {
+    summary.seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - m_startTime)
+                          .count();
+  }
+  m_summary = Summary();
+  m_started = false;
+  return summary;
+}
+
+void TransferPool::work() {
+  TFTPClient client(m_remoteAddress, m_port, "octet", m_log);
+  client.setVerbose(false);
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_queued.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+    if (m_tasks.empty()) return;
+    Task task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    ++m_running;
+    lock.unlock();
+
+    client.setOptions(task.options);
+    const std::string &local =
+        task.localFile.empty() ? task.fileName : task.localFile;
+    const TFTPClient::status result =
+        task.direction == TransferSession::Get
+            ? client.get(task.fileName, local)
+            : client.put(local, task.fileName);
+    const uint64_t bytes = client.lastTransferredBytes();
+    // Reports may do their own I/O; the other workers carry on meanwhile.
+    if (m_report) m_report(task, result, client.lastStats());
+
+    lock.lock();
+    --m_running;
+    if (result == TFTPClient::status::Success) {
+      ++m_summary.succeeded;
+      m_summary.bytes += bytes;
+    } else {
+      ++m_summary.failed;
+    }
+    if (m_tasks.empty() && m_running == 0) m_idle.notify_all();
+  }
+}
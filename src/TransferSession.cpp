@@ -0,0 +1,953 @@
+#include <TransferSession.h>
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+
+using boost::format;
+
+// Mode names are case-insensitive (RFC 1350).
+static bool isNetascii(const std::string &mode) {
+  return strcasecmp(mode.c_str(), "netascii") == 0;
+}
+
+TransferSession::TransferSession(Socket &socket, const std::string &ip,
+                                 uint16_t port, Direction direction,
+                                 const std::string &remoteFile,
+                                 const std::string &localFile,
+                                 const TransferOptions &options,
+                                 const RttEstimator &rtt)
+    : m_socket(socket),
+      m_remoteAddress(ip),
+      m_port(port),
+      m_direction(direction),
+      m_remoteFile(remoteFile),
+      m_localFile(localFile),
+      m_options(options),
+      m_digest(options.digest),
+      m_rtt(rtt) {}
+
+TransferSession::~TransferSession() { closeFiles(); }
+
+double TransferSession::losePercent() const {
+  return m_packets == 0 ? 0.0 : (m_losses * 100.0) / (m_packets * 1.0);
+}
+
+TransferSession::status TransferSession::start(Clock::time_point now) {
+  m_startTime = now;
+  m_stats.file = m_remoteFile;
+  m_stats.direction =
+      m_options.probe ? "probe" : m_direction == Get ? "get" : "put";
+  if (m_remoteFile.empty()) {
+    fail(status::EmptyFilename);
+    return m_result;
+  }
+
+  // Resolve once per transfer, in the family the socket was created for.
+  if (!m_server.resolve(m_remoteAddress, m_port, m_socket.GetFamily())) {
+    m_errorMessage = "Can't resolve " + m_remoteAddress + "!";
+    fail(status::InvalidSocket);
+    return m_result;
+  }
+  // An earlier transfer on this socket may have connected it to its TID.
+  m_socket.Disconnect();
+
+  m_netascii = isNetascii(m_options.mode);
+  if (!openFiles()) return m_result;
+
+  m_socket.SetSegmentation(m_options.offload && m_direction == Put);
+  m_socket.SetReceiveCoalescing(m_options.offload && m_direction == Get);
+  buildRequest();
+  if (m_target != -1) {
+    std::vector<struct iovec> buffers(m_buffers.size());
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+      buffers[i].iov_base = &m_buffers[i][0];
+      buffers[i].iov_len = m_buffers[i].size();
+    }
+    m_fixedBuffers =
+        m_socket.Ring()->registerBuffers(buffers.data(), buffers.size()) == 0;
+  }
+  // Drop datagrams left over from an earlier transfer on the same socket.
+  while (m_socket.RecvFrom(&m_buffers[0][0], m_buffers[0].size()) > 0) {
+  }
+
+  m_state = Requesting;
+  if (!sendRequest()) return m_result;
+  startRttSample(now);
+  m_progressAt = now;
+  m_deadline = now + m_rtt.timeout();
+  return status::Success;
+}
+
+TransferSession::status TransferSession::accept(
+    Clock::time_point now, const Endpoint &client, uint16_t blockSize,
+    uint16_t windowSize, const std::string &optionAck,
+    std::shared_ptr<const MappedFile> source) {
+  m_startTime = now;
+  m_stats.file = m_remoteFile;
+  m_stats.direction = m_direction == Get ? "get" : "put";
+  m_serving = true;
+  // Our socket is the transfer ID, the client's is known from its request.
+  m_peer = client;
+  m_remotePort = client.port();
+  if (!m_socket.Connect(m_peer)) {
+    fail(status::InvalidSocket);
+    return m_result;
+  }
+
+  m_netascii = isNetascii(m_options.mode);
+  if (!m_netascii) m_source = std::move(source);
+  if (!openFiles()) return m_result;
+
+  m_blockSize = blockSize;
+  m_windowSize = windowSize;
+  allocateBuffers(blockSize, windowSize);
+  m_state = Requesting;
+  m_progressAt = now;
+  m_deadline = now + m_rtt.timeout();
+  if (m_direction == Put && optionAck.empty()) {
+    // A plain RRQ is answered with the first DATA block.
+    m_state = Transferring;
+    beginPut(now);
+    return m_result;
+  }
+  // The OACK, or ACK 0 for a plain WRQ, is repeated like a request until
+  // the client answers.
+  if (optionAck.empty()) {
+    m_request.assign(m_headerSize, 0);
+    Packet::ack(m_request, 0);
+  } else {
+    m_request.assign(optionAck.begin(), optionAck.end());
+  }
+  if (!sendRequest()) return m_result;
+  startRttSample(now);
+  return status::Success;
+}
+
+bool TransferSession::openFiles() {
+  if (m_options.probe) return true;
+  const bool octet = !m_netascii;
+  const bool uring = m_socket.SetBackend(m_options.backend) &&
+                     m_socket.GetBackend() == Socket::UringBackend;
+  m_skipZeros = m_direction == Get && octet && m_options.sparse &&
+                !m_options.sink;
+  m_sparse.reset();
+  if (m_direction == Get ? m_options.sink != nullptr
+                         : m_options.source != nullptr) {
+    return true;
+  }
+  if (m_direction == Put && octet && !m_source) {
+    auto mapping = std::make_shared<MappedFile>();
+    if (mapping->open(m_localFile)) m_source = std::move(mapping);
+  }
+  if (m_direction == Get && octet && uring) {
+    openUringTarget();
+  } else if (m_direction == Get && m_options.writeBehind) {
+    m_writer.open(m_localFile, m_options.directIo);
+  }
+  const bool opened = m_source || m_target != -1 || m_writer.isOpen();
+  if (!opened) {
+    // Netascii is translated by the session, never by the stream.
+    const std::ios_base::openmode openMode =
+        (m_direction == Get ? std::ios_base::out : std::ios_base::in) |
+        std::ios_base::binary;
+    m_file.open(m_localFile.c_str(), openMode);
+  }
+  if (!opened && !m_file.is_open()) {
+    m_errorMessage = "Can't open file!";
+    fail(status::OpenFileError);
+    return false;
+  }
+  return true;
+}
+
+void TransferSession::allocateBuffers(uint16_t blockSize,
+                                      uint16_t windowSize) {
+  // One receive buffer per datagram of a full window, so a burst is read
+  // with a single recvmmsg. With GRO fewer but larger buffers. Put only
+  // receives ACKs and ERRORs.
+  if (m_socket.ReceiveCoalescingEnabled()) {
+    m_buffers.assign(m_coalescedBuffers, Buffer(m_coalescedBufferSize));
+  } else {
+    const uint16_t payload = m_direction == Put
+                                 ? m_defaultBlockSize
+                                 : std::max(blockSize, m_defaultBlockSize);
+    m_buffers.assign(std::clamp<size_t>(windowSize, 1, m_maxBurst),
+                     Buffer(m_headerSize + payload));
+  }
+}
+
+void TransferSession::buildRequest() {
+  // Only ask for blksize (RFC 2348) and windowsize (RFC 7440) when they
+  // differ from the defaults. Servers without option support ignore them
+  // and answer as plain RFC 1350 servers.
+  const Packet::Number blockSize(m_options.blockSize);
+  const Packet::Number windowSize(m_options.windowSize);
+  // RFC 2349 timeout is the server's retransmission interval in seconds.
+  const auto rto = std::chrono::duration_cast<std::chrono::seconds>(
+      m_rtt.timeout() + std::chrono::milliseconds(999));
+  m_peerTimeout = std::chrono::seconds(std::clamp<long>(rto.count(), 1, 255));
+  const Packet::Number timeout(m_peerTimeout.count());
+  Packet::Option options[4];
+  size_t count = 0;
+  if (m_options.blockSize != m_defaultBlockSize) {
+    options[count++] = {"blksize", blockSize.view()};
+  }
+  if (m_options.windowSize != 1) {
+    options[count++] = {"windowsize", windowSize.view()};
+  }
+  options[count++] = {"timeout", timeout.view()};
+  // RFC 2349: the server fills in the file's size, which an octet get
+  // into a file reserves up front.
+  if (m_direction == Get &&
+      (m_options.probe || (!m_netascii && !m_options.sink))) {
+    options[count++] = {"tsize", "0"};
+  }
+
+  const std::span<const Packet::Option> requested(options, count);
+  allocateBuffers(m_options.blockSize, m_options.windowSize);
+  m_request.assign(
+      Packet::requestSize(m_remoteFile, m_options.mode, requested), 0);
+  m_blockSize = m_defaultBlockSize;
+  m_windowSize = 1;
+  Packet::request(m_request, m_direction == Get ? Packet::RRQ : Packet::WRQ,
+                  m_remoteFile, m_options.mode, requested);
+}
+
+bool TransferSession::sendPacket(const char *packet, size_t size,
+                                 const Endpoint *to) {
+  return checkSent(m_socket.SendTo(packet, size, to), size);
+}
+
+bool TransferSession::checkSent(int sendNums, size_t size) {
+  ++m_packets;
+  if (sendNums == static_cast<int>(size)) return true;
+  // A full socket buffer is just another lost packet, the timer recovers.
+  if (sendNums == -1 &&
+      (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+    ++m_losses;
+    return true;
+  }
+  fail(status::WriteError);
+  return false;
+}
+
+bool TransferSession::sendRequest() {
+  // Before the first answer the request goes to the server's port.
+  return sendPacket(&m_request[0], m_request.size(),
+                    m_remotePort == 0 ? &m_server : peer());
+}
+
+bool TransferSession::sendAck(uint16_t block) {
+  char packet[m_headerSize];
+  return sendPacket(packet, Packet::ack(packet, block), peer());
+}
+
+void TransferSession::onReadable(Clock::time_point now) {
+  Datagram batch[m_maxBurst];
+  const size_t count = m_buffers.size();
+  for (size_t i = 0; i < count; ++i) {
+    batch[i].iov[0].iov_base = &m_buffers[i][0];
+    batch[i].iov[0].iov_len = m_buffers[i].size();
+    batch[i].iovCount = 1;
+  }
+  while (!finished()) {
+    // Queued writes may still read from the receive buffers.
+    if (!flushWrites()) return;
+    const int received = m_socket.RecvBatch(batch, count);
+    if (received < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        fail(status::ReadError);
+      }
+      return;
+    }
+    for (int i = 0; i < received && !finished(); ++i) {
+      if (!acceptSource(batch[i].source)) {
+        ++m_packets;
+        ++m_losses;
+        continue;
+      }
+      // Split GRO-coalesced reads back into the original datagrams.
+      const char *packet = &m_buffers[i][0];
+      m_currentBuffer = i;
+      const size_t length = batch[i].length;
+      const size_t segment =
+          batch[i].segmentSize > 0 ? batch[i].segmentSize : length;
+      for (size_t offset = 0; offset < length && !finished();
+           offset += segment) {
+        ++m_packets;
+        handlePacket(packet + offset, std::min(segment, length - offset), now);
+      }
+    }
+    if (static_cast<size_t>(received) < count) return;
+  }
+}
+
+bool TransferSession::acceptSource(const Endpoint &source) {
+  if (m_remotePort != 0) return source == m_peer;
+  // The first answer from the server's address fixes its transfer ID
+  // (RFC 1350, 4). From then on the kernel drops datagrams from any other
+  // source; ones queued before the connect are caught by the comparison.
+  Endpoint server = m_server;
+  server.setPort(source.port());
+  if (source != server) return false;
+  m_remotePort = source.port();
+  m_peer = source;
+  m_socket.Connect(m_peer);
+  return true;
+}
+
+bool TransferSession::onTimeout(Clock::time_point now) {
+  if (finished()) return false;
+  if (m_pacePending && now >= m_paceAt && now < m_deadline) {
+    // Not a timeout, the pacer has tokens for the next blocks.
+    fillWindow(now);
+    return false;
+  }
+  if (now < m_deadline) return false;
+
+  m_rtt.backoff();
+  m_rttPending = false;
+  ++m_losses;
+  ++m_stats.timeouts;
+  // Giving up goes by time, not retries: a short RTO runs out of retries
+  // before a peer that only resends on its own timeout gets a second go.
+  const Clock::time_point giveUpAt =
+      m_progressAt + m_giveUpTimeouts * m_peerTimeout;
+  if (now >= giveUpAt) {
+    fail(status::TimeOut);
+    return true;
+  }
+  m_deadline = std::min(now + m_rtt.timeout(), giveUpAt);
+
+  if (m_state == Requesting) {
+    ++m_stats.retransmits;
+    sendRequest();
+  } else if (m_direction == Get) {
+    // Re-ACK the last good block so the server restarts its window there.
+    m_windowCount = 0;
+    ++m_stats.retransmits;
+    sendAck(m_lastBlock);
+  } else {
+    m_congestion.onTimeout(m_nextBlock - 1);
+    m_nextBlock = m_ackedBlock + 1;
+    fillWindow(now);
+  }
+  return true;
+}
+
+void TransferSession::cancel(status code) {
+  if (!finished()) fail(code);
+}
+
+void TransferSession::handlePacket(const char *packet, size_t size,
+                                   Clock::time_point now) {
+  PacketView view;
+  const PacketView::Result parsed = view.parse({packet, size});
+  if (parsed == PacketView::UnknownOperation) {
+    m_errorMessage = (format("Unexpected packet received! Type: %i.") %
+                      view.operation())
+                         .str();
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  if (parsed != PacketView::Valid) {
+    ++m_losses;
+    return;
+  }
+  switch (view.operation()) {
+    case Packet::DATA:
+      m_receivedBlock = view.block();
+      handleData(view.payload().data(), view.payload().size(), now);
+      break;
+    case Packet::ACK:
+      m_receivedBlock = view.block();
+      handleAck(m_receivedBlock, now);
+      break;
+    case Packet::OACK:
+      handleOptionAck(view.options(), now);
+      break;
+    case Packet::ERR:
+      m_errorMessage = (format("Message from remote host: %s.") %
+                        std::string(view.errorMessage()))
+                           .str();
+      fail(status::ReadError);
+      break;
+    default:
+      m_errorMessage = (format("Unexpected packet received! Type: %i.") %
+                        view.operation())
+                           .str();
+      fail(status::UnexpectedPacketReceived);
+      break;
+  }
+}
+
+void TransferSession::handleOptionAck(const OptionList &options,
+                                      Clock::time_point now) {
+  if (m_serving) {
+    m_errorMessage = "Unexpected packet received! Type: 6.";
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  if (m_state != Requesting) {
+    // Our ACK of the OACK got lost, the server repeats the OACK.
+    if (m_direction == Get && m_blocks == 0) sendAck(0);
+    return;
+  }
+  if (!parseOptions(options)) {
+    m_errorMessage = "Invalid option acknowledgement.";
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  finishRttSample(now);
+  if (m_options.probe) {
+    // RFC 2347: the client declines the transfer with error 8.
+    finishProbe(8, "Size probe only");
+    return;
+  }
+  m_state = Transferring;
+  m_progressAt = now;
+  m_deadline = now + m_rtt.timeout();
+  if (m_direction == Get) {
+    preallocate();
+    if (sendAck(0)) startRttSample(now);
+  } else {
+    beginPut(now);
+  }
+}
+
+bool TransferSession::parseOptions(const OptionList &options) {
+  for (const Packet::Option &option : options) {
+    uint64_t value = 0;
+    if (Packet::sameName(option.name, "blksize")) {
+      if (!Packet::parseNumber(option.value, value) ||
+          value < m_minBlockSize || value > m_options.blockSize) {
+        return false;
+      }
+      m_blockSize = static_cast<uint16_t>(value);
+    } else if (Packet::sameName(option.name, "windowsize")) {
+      if (!Packet::parseNumber(option.value, value) || value < 1 ||
+          value > m_options.windowSize) {
+        return false;
+      }
+      m_windowSize = static_cast<uint16_t>(value);
+    } else if (Packet::sameName(option.name, "tsize") &&
+               Packet::parseNumber(option.value, value)) {
+      m_transferSize = value;
+      m_stats.sizeKnown = true;
+      m_stats.transferSize = value;
+    }
+  }
+  return true;
+}
+
+void TransferSession::handleData(const char *data, size_t payload,
+                                 Clock::time_point now) {
+  if (m_direction != Get) {
+    m_errorMessage = "Unexpected packet received! Type: 3.";
+    fail(status::UnexpectedPacketReceived);
+    return;
+  }
+  if (m_options.probe) {
+    // The server ignored the options; a short first block is the whole
+    // file, otherwise the size stays unknown.
+    finishRttSample(now);
+    if (m_receivedBlock == 1 && payload < m_blockSize) {
+      m_stats.sizeKnown = true;
+      m_stats.transferSize = payload;
+    }
+    finishProbe(0, "Size probe only");
+    return;
+  }
+  // A DATA answer to the request means the server ignored our options.
+  m_state = Transferring;
+
+  if (m_receivedBlock != static_cast<uint16_t>(m_lastBlock + 1)) {
+    // Duplicate or out of order (RFC 7440): ACK the last in-order block
+    // once, the server goes back and resends everything after it.
+    ++m_losses;
+    ++m_stats.duplicates;
+    if (!m_restartRequested) {
+      m_restartRequested = true;
+      m_windowCount = 0;
+      ++m_stats.retransmits;
+      sendAck(m_lastBlock);
+    }
+    return;
+  }
+  m_restartRequested = false;
+  firstByte(now);
+  finishRttSample(now);
+  m_progressAt = now;
+  m_deadline = now + m_rtt.timeout();
+
+  m_lastBlock = m_receivedBlock;
+  ++m_blocks;
+  const bool lastPacket = payload < m_blockSize;
+  if (m_netascii) {
+    m_translated.resize(NetasciiDecoder<>::maxDecoded(payload));
+    size_t size = m_decoder.decode(data, payload, &m_translated[0]);
+    if (lastPacket) size += m_decoder.finish(&m_translated[size]);
+    if (!storeData(&m_translated[0], size)) return;
+  } else if (!storeData(data, payload)) {
+    return;
+  }
+  m_bytes += payload;
+  publishProgress();
+
+  // The final ACK promises the whole file is on disk.
+  if (lastPacket) {
+    if (!flushWrites()) return;
+    if ((m_writer.isOpen() && !m_writer.finish()) ||
+        (m_options.sink && !m_options.sink->finish()) || !finishSparse()) {
+      fail(status::WriteFileError);
+      return;
+    }
+  }
+  if (++m_windowCount >= m_windowSize || lastPacket) {
+    m_windowCount = 0;
+    if (!sendAck(m_lastBlock)) return;
+    if (lastPacket) {
+      complete();
+      return;
+    }
+    startRttSample(now);
+  }
+}
+
+bool TransferSession::storeData(const char *data, size_t size) {
+  m_digest.update(data, size);
+  if (m_options.sink) {
+    const Clock::time_point writeStart = Clock::now();
+    const bool written = m_options.sink->write(data, size);
+    addDiskStall(writeStart);
+    if (written) return true;
+    fail(status::WriteFileError);
+    return false;
+  }
+  if (m_skipZeros && size > 0 && SparseFile::isZero(data, size)) {
+    return skipZeros(size);
+  }
+  if (m_target != -1) return queueWrite(data, size, m_bytes);
+  if (m_writer.isOpen()) {
+    if (m_writer.write(data, size)) return true;
+    fail(status::WriteFileError);
+    return false;
+  }
+  const Clock::time_point writeStart = Clock::now();
+  m_file.write(data, size);
+  addDiskStall(writeStart);
+  if (!m_file.bad()) return true;
+  fail(status::WriteFileError);
+  return false;
+}
+
+bool TransferSession::skipZeros(size_t size) {
+  // The file starts out empty, so leaving the bytes out writes the zeros.
+  m_sparse.skip(m_bytes, size);
+  if (m_target != -1) return true;
+  if (m_writer.isOpen() ? m_writer.skip(size)
+                        : !m_file.seekp(size, std::ios_base::cur).fail()) {
+    return true;
+  }
+  fail(status::WriteFileError);
+  return false;
+}
+
+void TransferSession::preallocate() {
+  if (m_transferSize == 0 || m_netascii || m_options.sink) return;
+  const int fd = m_target != -1
+                     ? m_target
+                     : ::open(m_localFile.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1) return;
+  // Where the file system can't, the file just grows as it is written.
+  m_sparse.preallocate(fd, m_transferSize);
+  if (fd != m_target) ::close(fd);
+}
+
+bool TransferSession::finishSparse() {
+  if (!m_sparse.preallocated() && m_sparse.skippedBytes() == 0) return true;
+  if (m_file.is_open() && !m_file.flush()) return false;
+  const int fd = m_target != -1
+                     ? m_target
+                     : ::open(m_localFile.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1) return false;
+  const bool finished = m_sparse.finish(fd, m_bytes);
+  if (fd != m_target) ::close(fd);
+  return finished;
+}
+
+void TransferSession::handleAck(uint16_t block, Clock::time_point now) {
+  if (m_direction != Put) return;
+  if (m_state == Requesting) {
+    if (block != 0) return;
+    m_state = Transferring;
+    finishRttSample(now);
+    m_progressAt = now;
+    m_deadline = now + m_rtt.timeout();
+    beginPut(now);
+    return;
+  }
+
+  const uint16_t advance = block - static_cast<uint16_t>(m_ackedBlock & 0xffff);
+  if (advance == 0 || advance > m_nextBlock - 1 - m_ackedBlock) {
+    // Duplicate or stale ACK. Resending on it would multiply duplicates
+    // (Sorcerer's Apprentice), the retransmission timeout handles it.
+    ++m_losses;
+    ++m_stats.duplicates;
+    if (advance == 0) m_congestion.onCongestion(m_ackedBlock, m_nextBlock - 1);
+    return;
+  }
+  m_progressAt = now;
+  firstByte(now);
+  finishRttSample(now);
+  m_deadline = now + m_rtt.timeout();
+  for (uint32_t acked = m_ackedBlock + 1; acked <= m_ackedBlock + advance;
+       ++acked) {
+    m_bytes += m_packetSizes[acked % m_windowSize] - m_headerSize;
+  }
+  // Path RTT of the newest block, unless it was retransmitted.
+  const Clock::time_point sentAt =
+      m_sentAt[(m_ackedBlock + advance) % m_windowSize];
+  m_congestion.onAck(advance,
+                     sentAt == Clock::time_point()
+                         ? CongestionControl::Duration::zero()
+                         : std::chrono::duration_cast<
+                               CongestionControl::Duration>(now - sentAt),
+                     now);
+  m_ackedBlock += advance;
+  m_blocks = m_ackedBlock;
+  publishProgress();
+  if (m_ackedBlock == m_finalBlock) {
+    complete();
+    return;
+  }
+  if (m_ackedBlock + 1 != m_nextBlock) {
+    // The receiver stopped at a gap (RFC 7440).
+    ++m_losses;
+    m_congestion.onCongestion(m_ackedBlock, m_nextBlock - 1);
+    m_nextBlock = m_ackedBlock + 1;
+  }
+  fillWindow(now);
+}
+
+void TransferSession::beginPut(Clock::time_point now) {
+  if (m_source) {
+    m_headers.assign(m_windowSize, Header());
+  } else {
+    m_window.assign(m_windowSize, Buffer(m_headerSize + m_blockSize));
+  }
+  if (m_netascii) {
+    // Up to a block of leftovers plus one block read and doubled.
+    m_raw.assign(m_blockSize, 0);
+    m_encoded.assign(m_blockSize +
+                         NetasciiEncoder<>::maxEncoded(m_blockSize),
+                     0);
+    m_encodedBegin = m_encodedEnd = 0;
+    m_rawEnd = false;
+  }
+  m_packetSizes.assign(m_windowSize, 0);
+  m_sentAt.assign(m_windowSize, Clock::time_point());
+  fillWindow(now);
+}
+
+void TransferSession::fillWindow(Clock::time_point now) {
+  Datagram burst[m_maxBurst];
+  size_t count = 0;
+  updatePacer();
+  m_pacePending = false;
+  while (m_nextBlock - m_ackedBlock <= m_windowSize &&
+         (m_finalBlock == 0 || m_nextBlock <= m_finalBlock)) {
+    const Clock::duration wait =
+        m_pacer.reserve(m_headerSize + m_blockSize, now);
+    if (wait > Clock::duration::zero()) {
+      m_pacePending = true;
+      m_paceAt = now + wait;
+      break;
+    }
+    const size_t slot = m_nextBlock % m_windowSize;
+    const bool retransmit = m_nextBlock <= m_readBlock;
+    m_sentAt[slot] = retransmit ? Clock::time_point() : now;
+    Datagram &datagram = burst[count++];
+    if (m_source) {
+      const uint64_t offset =
+          static_cast<uint64_t>(m_nextBlock - 1) * m_blockSize;
+      const size_t payload =
+          offset >= m_source->size()
+              ? 0
+              : std::min<uint64_t>(m_blockSize, m_source->size() - offset);
+      char *header = m_headers[slot].data();
+      Packet::dataHeader(m_headers[slot], static_cast<uint16_t>(m_nextBlock));
+      datagram.iov[0].iov_base = header;
+      datagram.iov[0].iov_len = m_headerSize;
+      datagram.iov[1].iov_base = const_cast<char *>(m_source->data()) + offset;
+      datagram.iov[1].iov_len = payload;
+      datagram.iovCount = payload > 0 ? 2 : 1;
+      m_packetSizes[slot] = m_headerSize + payload;
+      if (!retransmit) {
+        const char *data = m_source->data() + offset;
+        if (m_digest.enabled() && !MappedFile::guarded([&] {
+              m_digest.update(data, payload);
+            })) {
+          m_errorMessage = "File was truncated!";
+          fail(status::ReadFileError);
+          return;
+        }
+        if (payload < m_blockSize) m_finalBlock = m_nextBlock;
+      }
+    } else {
+      Buffer &packet = m_window[slot];
+      if (!retransmit) {
+        Packet::dataHeader(packet, static_cast<uint16_t>(m_nextBlock));
+        const Clock::time_point readStart = Clock::now();
+        const std::streamsize payload = readBlock(&packet[m_headerSize]);
+        addDiskStall(readStart);
+        if (payload < 0) {
+          fail(status::ReadFileError);
+          return;
+        }
+        m_packetSizes[slot] = m_headerSize + payload;
+        if (payload < m_blockSize) m_finalBlock = m_nextBlock;
+      }
+      datagram.iov[0].iov_base = &packet[0];
+      datagram.iov[0].iov_len = m_packetSizes[slot];
+      datagram.iovCount = 1;
+    }
+
+    if (retransmit) {
+      ++m_losses;
+      ++m_stats.retransmits;
+      m_rttPending = false;
+    } else {
+      m_readBlock = m_nextBlock;
+      startRttSample(now);
+    }
+    ++m_nextBlock;
+    if (count == m_maxBurst && !sendBurst(burst, count)) return;
+  }
+  sendBurst(burst, count);
+}
+
+std::streamsize TransferSession::readRaw(char *out, size_t size) {
+  std::streamsize read;
+  if (m_options.source) {
+    read = m_options.source->read(out, size);
+  } else {
+    m_file.read(out, size);
+    read = m_file.bad() ? -1 : m_file.gcount();
+  }
+  if (read > 0) m_digest.update(out, read);
+  return read;
+}
+
+std::streamsize TransferSession::readBlock(char *out) {
+  if (!m_netascii) {
+    return readRaw(out, m_blockSize);
+  }
+  // Encoding expands, so blocks are cut from a buffer of encoded bytes;
+  // what is left of it moves to the front first.
+  const size_t left = m_encodedEnd - m_encodedBegin;
+  std::memmove(&m_encoded[0], &m_encoded[m_encodedBegin], left);
+  m_encodedBegin = 0;
+  m_encodedEnd = left;
+  while (m_encodedEnd < m_blockSize && !m_rawEnd) {
+    const std::streamsize raw = readRaw(&m_raw[0], m_blockSize);
+    if (raw < 0) return -1;
+    m_rawEnd = raw < m_blockSize;
+    m_encodedEnd +=
+        NetasciiEncoder<>::encode(&m_raw[0], raw, &m_encoded[m_encodedEnd]);
+  }
+  const size_t size = std::min<size_t>(m_blockSize, m_encodedEnd);
+  std::memcpy(out, &m_encoded[0], size);
+  m_encodedBegin = size;
+  return size;
+}
+
+void TransferSession::updatePacer() {
+  // Rate cap and congestion rate, whichever is lower; the burst covers a
+  // timer tick so coarse wakeups don't lower the rate.
+  const size_t packet = m_headerSize + m_blockSize;
+  uint64_t rate = m_options.rateLimit / 8;
+  if (m_options.congestionControl) {
+    const uint64_t congestion = m_congestion.rate(packet);
+    if (congestion > 0 && (rate == 0 || congestion < rate)) rate = congestion;
+  }
+  const uint64_t burst =
+      rate * std::chrono::microseconds(m_pacingQuantum).count() / 1000000;
+  m_pacer.setRate(rate, std::max<uint64_t>(2 * packet, burst));
+}
+
+bool TransferSession::sendBurst(Datagram *burst, size_t &count) {
+  if (count == 0) return true;
+  const int sent = m_socket.SendBatch(burst, count, peer());
+  m_packets += count;
+  if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+    // Only a mapping the file no longer backs makes the kernel fault.
+    if (errno == EFAULT && m_source) {
+      m_errorMessage = "File was truncated!";
+      fail(status::ReadFileError);
+    } else {
+      fail(status::WriteError);
+    }
+    return false;
+  }
+  // Whatever did not fit into the socket buffer is lost, the timer recovers.
+  m_losses += count - std::max(sent, 0);
+  count = 0;
+  return true;
+}
+
+bool TransferSession::openUringTarget() {
+  m_target = ::open(m_localFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (m_target != -1) m_socket.Ring()->clearFileError();
+  return m_target != -1;
+}
+
+bool TransferSession::queueWrite(const char *data, size_t size,
+                                 uint64_t offset) {
+  IoUring *ring = m_socket.Ring();
+  if (ring->fileError() != 0) {
+    fail(status::WriteFileError);
+    return false;
+  }
+  if (size == 0) return true;
+  struct io_uring_sqe *entry = ring->sqe();
+  if (entry == nullptr) {
+    fail(status::WriteFileError);
+    return false;
+  }
+  entry->opcode = m_fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  entry->fd = m_target;
+  entry->addr = reinterpret_cast<uintptr_t>(data);
+  entry->len = static_cast<uint32_t>(size);
+  entry->off = offset;
+  entry->buf_index = static_cast<uint16_t>(m_currentBuffer);
+  entry->user_data = size;
+  ring->fileOpQueued();
+  return true;
+}
+
+bool TransferSession::flushWrites() {
+  if (m_target == -1) return true;
+  IoUring *ring = m_socket.Ring();
+  if (ring->pendingFileOps() == 0 && ring->fileError() == 0) return true;
+  const Clock::time_point waitStart = Clock::now();
+  const int error = ring->waitFileOps();
+  addDiskStall(waitStart);
+  if (error == 0) return true;
+  fail(status::WriteFileError);
+  return false;
+}
+
+void TransferSession::closeFiles() {
+  m_file.close();
+  m_writer.close();
+  m_source.reset();
+  if (m_target == -1) return;
+  IoUring *ring = m_socket.Ring();
+  if (ring != nullptr) {
+    ring->waitFileOps();
+    if (m_fixedBuffers) ring->unregisterBuffers();
+  }
+  m_fixedBuffers = false;
+  ::close(m_target);
+  m_target = -1;
+}
+
+void TransferSession::finishStats() {
+  m_stats.result = m_result;
+  m_stats.bytes = m_bytes;
+  m_stats.blocks = m_blocks;
+  m_stats.packets = m_packets;
+  m_stats.diskStall += m_writer.stallTime();
+  m_stats.sparseBytes = m_sparse.skippedBytes();
+  m_stats.duration = std::chrono::duration_cast<TransferStats::Duration>(
+      Clock::now() - m_startTime);
+}
+
+void TransferSession::complete() {
+  if (m_digest.enabled()) {
+    m_stats.digest = m_digest.value();
+    const std::string &expected = m_options.expectedDigest;
+    if (!expected.empty() &&
+        strcasecmp(expected.c_str(), m_stats.digest.c_str()) != 0) {
+      m_errorMessage = "Expected " + expected + ", got " + m_stats.digest;
+      fail(status::DigestMismatch);
+      return;
+    }
+  }
+  m_state = Done;
+  m_result = status::Success;
+  closeFiles();
+  finishStats();
+}
+
+void TransferSession::finishProbe(uint16_t error, const char *message) {
+  char packet[m_headerSize + m_defaultBlockSize];
+  sendPacket(packet, Packet::error(packet, error, message), peer());
+  m_state = Done;
+  m_result = status::Success;
+  finishStats();
+}
+
+void TransferSession::fail(status code) {
+  m_state = Failed;
+  m_result = code;
+  if (m_serving) sendError(code);
+  closeFiles();
+  finishStats();
+}
+
+void TransferSession::sendError(status code) {
+  // Only local failures are news to the client.
+  uint16_t error = 0;
+  std::string message;
+  switch (code) {
+    case status::OpenFileError:
+      error = m_direction == Put ? 1 : 2;
+      message = m_direction == Put ? "File not found" : "Access violation";
+      break;
+    case status::WriteFileError:
+      error = 3;
+      message = "Disk full or allocation exceeded";
+      break;
+    case status::ReadFileError:
+      message = "Read error";
+      break;
+    case status::UnexpectedPacketReceived:
+      error = 4;
+      message = "Illegal TFTP operation";
+      break;
+    case status::TimeOut:
+    case status::Cancelled:
+      message = "Transfer aborted";
+      break;
+    default:
+      return;
+  }
+  char packet[m_headerSize + m_defaultBlockSize];
+  m_socket.SendTo(packet, Packet::error(packet, error, message), peer());
+}
+
+void TransferSession::startRttSample(Clock::time_point now) {
+  if (!m_rttPending) {
+    m_rttPending = true;
+    m_rttStart = now;
+  }
+}
+
+void TransferSession::finishRttSample(Clock::time_point now) {
+  if (m_rttPending) {
+    m_rttPending = false;
+    const auto sample =
+        std::chrono::duration_cast<RttEstimator::Duration>(now - m_rttStart);
+    m_rtt.sample(sample);
+    m_stats.recordRtt(sample);
+  }
+}
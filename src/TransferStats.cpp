@@ -0,0 +1,204 @@
+#include <TransferStats.h>
+
+#include <cstdio>
+
+constexpr std::array<uint32_t, TransferStats::m_rttBuckets>
+    TransferStats::m_rttBounds;
+
+static std::string jsonString(const std::string &text) {
+  std::string quoted = "\"";
+  for (const unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+static double seconds(TransferStats::Duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+void TransferStats::recordRtt(Duration sample) {
+  size_t bucket = 0;
+  while (bucket < m_rttBuckets &&
+         sample.count() > static_cast<int64_t>(m_rttBounds[bucket])) {
+    ++bucket;
+  }
+  ++rtt[bucket];
+  ++rttSamples;
+  rttSum += sample;
+}
+
+std::string TransferStats::toJson() const {
+  std::string histogram;
+  for (size_t i = 0; i < rtt.size(); ++i) {
+    if (i > 0) histogram += ",";
+    histogram += std::to_string(rtt[i]);
+  }
+  char numbers[512];
+  std::snprintf(
+      numbers, sizeof(numbers),
+      "\"result\":%d,\"bytes\":%llu,\"blocks\":%llu,\"packets\":%llu,"
+      "\"retransmits\":%llu,\"duplicates\":%llu,\"timeouts\":%llu,"
+      "\"sparse_bytes\":%llu,"
+      "\"rtt_samples\":%llu,\"rtt_mean_s\":%.6f,\"ttfb_s\":%s,"
+      "\"duration_s\":%.6f,\"disk_stall_s\":%.6f",
+      result, static_cast<unsigned long long>(bytes),
+      static_cast<unsigned long long>(blocks),
+      static_cast<unsigned long long>(packets),
+      static_cast<unsigned long long>(retransmits),
+      static_cast<unsigned long long>(duplicates),
+      static_cast<unsigned long long>(timeouts),
+      static_cast<unsigned long long>(sparseBytes),
+      static_cast<unsigned long long>(rttSamples),
+      rttSamples > 0 ? seconds(rttSum) / rttSamples : 0.0,
+      firstByte ? std::to_string(seconds(timeToFirstByte)).c_str() : "null",
+      seconds(duration), seconds(diskStall));
+  std::string bounds;
+  for (size_t i = 0; i < m_rttBounds.size(); ++i) {
+    if (i > 0) bounds += ",";
+    bounds += std::to_string(m_rttBounds[i]);
+  }
+  return "{\"file\":" + jsonString(file) +
+         ",\"direction\":" + jsonString(direction) +
+         (digest.empty() ? "" : ",\"digest\":" + jsonString(digest)) +
+         (sizeKnown ? ",\"tsize\":" + std::to_string(transferSize) : "") +
+         "," + numbers +
+         ",\"rtt_bounds_us\":[" + bounds + "],\"rtt_histogram\":[" +
+         histogram + "]}";
+}
+
+MetricsExporter::MetricsExporter(const std::string &jsonPath,
+                                 const std::string &prometheusPath)
+    : m_jsonPath(jsonPath), m_prometheusPath(prometheusPath) {}
+
+void MetricsExporter::record(const TransferStats &stats) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_jsonPath.empty()) {
+    std::FILE *file = std::fopen(m_jsonPath.c_str(), "a");
+    if (file != nullptr) {
+      const std::string line = stats.toJson() + "\n";
+      std::fwrite(line.data(), 1, line.size(), file);
+      std::fclose(file);
+    }
+  }
+
+  Totals &totals = m_totals[stats.direction];
+  if (stats.result == 0) {
+    ++totals.succeeded;
+  } else {
+    ++totals.failed;
+  }
+  totals.bytes += stats.bytes;
+  totals.blocks += stats.blocks;
+  totals.packets += stats.packets;
+  totals.retransmits += stats.retransmits;
+  totals.duplicates += stats.duplicates;
+  totals.timeouts += stats.timeouts;
+  for (size_t i = 0; i < stats.rtt.size(); ++i) totals.rtt[i] += stats.rtt[i];
+  totals.rttSamples += stats.rttSamples;
+  totals.rttSeconds += seconds(stats.rttSum);
+  if (stats.firstByte) {
+    ++totals.firstBytes;
+    totals.firstByteSeconds += seconds(stats.timeToFirstByte);
+  }
+  totals.seconds += seconds(stats.duration);
+  totals.diskStallSeconds += seconds(stats.diskStall);
+
+  if (!m_prometheusPath.empty()) writePrometheus();
+}
+
+bool MetricsExporter::writePrometheus() const {
+  // The textfile collector may read at any time: write aside, then rename.
+  const std::string temporary = m_prometheusPath + ".tmp";
+  std::FILE *file = std::fopen(temporary.c_str(), "w");
+  if (file == nullptr) return false;
+
+  const auto counter = [&](const char *name, const char *help,
+                           uint64_t Totals::*field) {
+    std::fprintf(file, "# HELP ltftp_%s %s\n# TYPE ltftp_%s counter\n", name,
+                 help, name);
+    for (const auto &entry : m_totals) {
+      std::fprintf(file, "ltftp_%s{direction=\"%s\"} %llu\n", name,
+                   entry.first.c_str(),
+                   static_cast<unsigned long long>(entry.second.*field));
+    }
+  };
+  const auto seconds = [&](const char *name, const char *help,
+                           double Totals::*field) {
+    std::fprintf(file, "# HELP ltftp_%s %s\n# TYPE ltftp_%s counter\n", name,
+                 help, name);
+    for (const auto &entry : m_totals) {
+      std::fprintf(file, "ltftp_%s{direction=\"%s\"} %.6f\n", name,
+                   entry.first.c_str(), entry.second.*field);
+    }
+  };
+
+  std::fprintf(file,
+               "# HELP ltftp_transfers_total Finished transfers.\n"
+               "# TYPE ltftp_transfers_total counter\n");
+  for (const auto &entry : m_totals) {
+    std::fprintf(file,
+                 "ltftp_transfers_total{direction=\"%s\",result=\"success\"} "
+                 "%llu\n"
+                 "ltftp_transfers_total{direction=\"%s\",result=\"failure\"} "
+                 "%llu\n",
+                 entry.first.c_str(),
+                 static_cast<unsigned long long>(entry.second.succeeded),
+                 entry.first.c_str(),
+                 static_cast<unsigned long long>(entry.second.failed));
+  }
+  counter("bytes_total", "Payload bytes transferred.", &Totals::bytes);
+  counter("blocks_total", "DATA blocks transferred.", &Totals::blocks);
+  counter("packets_total", "Packets sent and received.", &Totals::packets);
+  counter("retransmits_total", "Retransmitted DATA or ACK packets.",
+          &Totals::retransmits);
+  counter("duplicates_total", "Duplicate or out of order packets.",
+          &Totals::duplicates);
+  counter("timeouts_total", "Retransmission timeouts.", &Totals::timeouts);
+  counter("first_byte_total", "Transfers that received a first answer.",
+          &Totals::firstBytes);
+  seconds("first_byte_seconds_total", "Summed time to first byte.",
+          &Totals::firstByteSeconds);
+  seconds("transfer_seconds_total", "Summed transfer time.",
+          &Totals::seconds);
+  seconds("disk_stall_seconds_total", "Time spent waiting for the disk.",
+          &Totals::diskStallSeconds);
+
+  std::fprintf(file,
+               "# HELP ltftp_rtt_seconds Round trip time samples.\n"
+               "# TYPE ltftp_rtt_seconds histogram\n");
+  for (const auto &entry : m_totals) {
+    const Totals &totals = entry.second;
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < TransferStats::m_rttBuckets; ++i) {
+      cumulative += totals.rtt[i];
+      std::fprintf(file,
+                   "ltftp_rtt_seconds_bucket{direction=\"%s\",le=\"%g\"} "
+                   "%llu\n",
+                   entry.first.c_str(), TransferStats::m_rttBounds[i] / 1e6,
+                   static_cast<unsigned long long>(cumulative));
+    }
+    std::fprintf(file,
+                 "ltftp_rtt_seconds_bucket{direction=\"%s\",le=\"+Inf\"} "
+                 "%llu\n"
+                 "ltftp_rtt_seconds_sum{direction=\"%s\"} %.6f\n"
+                 "ltftp_rtt_seconds_count{direction=\"%s\"} %llu\n",
+                 entry.first.c_str(),
+                 static_cast<unsigned long long>(totals.rttSamples),
+                 entry.first.c_str(), totals.rttSeconds, entry.first.c_str(),
+                 static_cast<unsigned long long>(totals.rttSamples));
+  }
+
+  const bool written = std::fclose(file) == 0;
+  return written &&
+         std::rename(temporary.c_str(), m_prometheusPath.c_str()) == 0;
+}
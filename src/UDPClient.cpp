@@ -1,5 +1,10 @@
 #include <UDPClient.h>
 
+#include <fcntl.h>
+#include <netinet/udp.h>
+#include <algorithm>
+#include <cerrno>
+
 Socket::Socket() {
   _sock_desc = -1;
 }
@@ -8,55 +13,290 @@ Socket::~Socket() {
   close(_sock_desc);
 }
 
-int Socket::SendTo(const char *buffer, size_t size, const char *host, uint16_t port) {
-  struct sockaddr_in remoteAddr;
-  remoteAddr.sin_family = AF_INET;
-  remoteAddr.sin_addr.s_addr = host != nullptr ? ::inet_addr(host) : INADDR_ANY;
-  remoteAddr.sin_port = htons(port);
-  ::memset(remoteAddr.sin_zero, '\0', sizeof(remoteAddr.sin_zero));
-  int status = sendto(_sock_desc, buffer, size, 0, (sockaddr *)&remoteAddr, sizeof(remoteAddr));
-  return status;
-}
-
-int Socket::RecvFrom(void *buffer, size_t size, char *host, uint16_t *port) {
-  int addr_len = sizeof(sockaddr_in);
-  ::memset(&remoteAddrInfo, '\0', sizeof(remoteAddrInfo));
-  int received = recvfrom(_sock_desc, buffer, size, 0, (sockaddr *)&remoteAddrInfo, (socklen_t *)&addr_len);
-  bool recv_failed = received == -1;
-  bool no_messages = received == 0;
-  if (received > 0) {
-    if (host != nullptr) {
-      ::strcpy(host, inet_ntoa(remoteAddrInfo.sin_addr));
+static void SetDestination(struct msghdr &message, const Endpoint *to) {
+  if (to == nullptr) return;
+  message.msg_name = const_cast<sockaddr *>(to->address());
+  message.msg_namelen = to->length();
+}
+
+int Socket::SendTo(const char *buffer, size_t size, const Endpoint *to) {
+  if (m_ring) {
+    struct iovec iov = {const_cast<char *>(buffer), size};
+    return SendVecTo(&iov, 1, to);
+  }
+  if (to == nullptr) return send(_sock_desc, buffer, size, 0);
+  return sendto(_sock_desc, buffer, size, 0, to->address(), to->length());
+}
+
+int Socket::SendVecTo(const struct iovec *iov, size_t count, const Endpoint *to) {
+  struct mmsghdr message;
+  ::memset(&message, 0, sizeof(message));
+  SetDestination(message.msg_hdr, to);
+  message.msg_hdr.msg_iov = const_cast<struct iovec *>(iov);
+  message.msg_hdr.msg_iovlen = count;
+  return SendMessages(&message, 1) == 1 ? static_cast<int>(message.msg_len) : -1;
+}
+
+int Socket::SendMessages(struct mmsghdr *messages, size_t count) {
+  if (m_ring) return m_ring->transferMessages(IORING_OP_SENDMSG, _sock_desc, messages, count, false);
+  return sendmmsg(_sock_desc, messages, count, 0);
+}
+
+int Socket::RecvMessages(struct mmsghdr *messages, size_t count) {
+  if (m_ring) return m_ring->transferMessages(IORING_OP_RECVMSG, _sock_desc, messages, count, true);
+  return recvmmsg(_sock_desc, messages, count, 0, nullptr);
+}
+
+static size_t DatagramLength(const Datagram &datagram) {
+  size_t length = 0;
+  for (size_t i = 0; i < datagram.iovCount; i++) length += datagram.iov[i].iov_len;
+  return length;
+}
+
+int Socket::SendBatch(const Datagram *datagrams, size_t count, const Endpoint *to) {
+  struct mmsghdr messages[m_maxBatch];
+  size_t sent = 0;
+  while (sent < count) {
+    size_t chunk = std::min(count - sent, m_maxBatch);
+    if (m_segmentation) {
+      const size_t grouped = SegmentGroup(datagrams + sent, count - sent);
+      if (grouped > 1) {
+        const int status = SendSegmented(datagrams + sent, grouped, to);
+        if (status >= 0) {
+          sent += grouped;
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+          return sent > 0 ? static_cast<int>(sent) : status;
+        }
+        // The kernel or the device refused segmentation offload.
+        m_segmentation = false;
+      } else {
+        chunk = 1;
+      }
+    }
+    ::memset(messages, 0, sizeof(messages[0]) * chunk);
+    for (size_t i = 0; i < chunk; i++) {
+      SetDestination(messages[i].msg_hdr, to);
+      messages[i].msg_hdr.msg_iov = const_cast<struct iovec *>(datagrams[sent + i].iov);
+      messages[i].msg_hdr.msg_iovlen = datagrams[sent + i].iovCount;
+    }
+    const int status = SendMessages(messages, chunk);
+    if (status <= 0) return sent > 0 ? static_cast<int>(sent) : status;
+    sent += status;
+    if (static_cast<size_t>(status) < chunk) break;
+  }
+  return static_cast<int>(sent);
+}
+
+size_t Socket::SegmentGroup(const Datagram *datagrams, size_t count) const {
+  const size_t segmentSize = DatagramLength(datagrams[0]);
+  size_t total = segmentSize;
+  size_t grouped = 1;
+  while (grouped < count && grouped < m_maxSegments) {
+    const size_t length = DatagramLength(datagrams[grouped]);
+    if (length > segmentSize || total + length > m_maxSegmentBytes) break;
+    total += length;
+    grouped++;
+    // Only the last segment of a GSO send may be shorter.
+    if (length < segmentSize) break;
+  }
+  return grouped;
+}
+
+int Socket::SendSegmented(const Datagram *datagrams, size_t count, const Endpoint *to) {
+  struct iovec iov[2 * m_maxSegments];
+  size_t iovCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < datagrams[i].iovCount; j++) iov[iovCount++] = datagrams[i].iov[j];
+  }
+
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  ::memset(control, 0, sizeof(control));
+  struct mmsghdr batch;
+  ::memset(&batch, 0, sizeof(batch));
+  struct msghdr &message = batch.msg_hdr;
+  SetDestination(message, to);
+  message.msg_iov = iov;
+  message.msg_iovlen = iovCount;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  const uint16_t segmentSize = static_cast<uint16_t>(DatagramLength(datagrams[0]));
+  ::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+  return SendMessages(&batch, 1) == 1 ? static_cast<int>(batch.msg_len) : -1;
+}
+
+int Socket::RecvBatch(Datagram *datagrams, size_t count) {
+  struct mmsghdr messages[m_maxBatch];
+  struct sockaddr_storage sources[m_maxBatch];
+  char controls[m_maxBatch][CMSG_SPACE(sizeof(int))];
+  const size_t chunk = std::min(count, m_maxBatch);
+  ::memset(messages, 0, sizeof(messages[0]) * chunk);
+  for (size_t i = 0; i < chunk; i++) {
+    messages[i].msg_hdr.msg_name = &sources[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+    messages[i].msg_hdr.msg_iov = datagrams[i].iov;
+    messages[i].msg_hdr.msg_iovlen = datagrams[i].iovCount;
+    if (m_coalescing) {
+      messages[i].msg_hdr.msg_control = controls[i];
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
     }
-    if (port != nullptr) {
-      *port = ntohs(remoteAddrInfo.sin_port);
+  }
+  const int received = RecvMessages(messages, chunk);
+  for (int i = 0; i < received; i++) {
+    datagrams[i].length = messages[i].msg_len;
+    datagrams[i].source.assign((sockaddr *)&sources[i], messages[i].msg_hdr.msg_namelen);
+    datagrams[i].segmentSize = 0;
+    if (!m_coalescing) continue;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int segmentSize;
+        ::memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+        datagrams[i].segmentSize = static_cast<uint16_t>(segmentSize);
+      }
     }
   }
   return received;
 }
 
+bool Socket::SetSegmentation(bool enable) {
+  // A zero default size only probes for UDP_SEGMENT support, the size is
+  // given per send.
+  int segmentSize = 0;
+  m_segmentation = enable && ::setsockopt(_sock_desc, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof(segmentSize)) == 0;
+  return m_segmentation;
+}
+
+bool Socket::SetReceiveCoalescing(bool enable) {
+  if (!enable && !m_coalescing) return false;
+  int value = enable ? 1 : 0;
+  const bool applied = ::setsockopt(_sock_desc, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+  m_coalescing = enable && applied;
+  return m_coalescing;
+}
+
+int Socket::RecvFrom(void *buffer, size_t size, Endpoint *from) {
+  if (from == nullptr) return recv(_sock_desc, buffer, size, 0);
+  struct sockaddr_storage source;
+  socklen_t length = sizeof(source);
+  int received = recvfrom(_sock_desc, buffer, size, 0, (sockaddr *)&source, &length);
+  if (received >= 0) from->assign((sockaddr *)&source, length);
+  return received;
+}
+
+bool Socket::Connect(const Endpoint &peer) {
+  m_connected = ::connect(_sock_desc, peer.address(), peer.length()) == 0;
+  return m_connected;
+}
+
+bool Socket::Disconnect() {
+  if (!m_connected) return true;
+  // Connecting to AF_UNSPEC dissolves the association (connect(2)).
+  struct sockaddr unspecified;
+  ::memset(&unspecified, 0, sizeof(unspecified));
+  unspecified.sa_family = AF_UNSPEC;
+  // Some kernels answer EAFNOSUPPORT but dissolve it all the same.
+  const int result = ::connect(_sock_desc, &unspecified, sizeof(unspecified));
+  m_connected = false;
+  return result == 0 || errno == EAFNOSUPPORT;
+}
+
+bool Socket::GetLocalEndpoint(Endpoint &local) const {
+  struct sockaddr_storage address;
+  socklen_t length = sizeof(address);
+  if (::getsockname(_sock_desc, (sockaddr *)&address, &length) != 0) {
+    return false;
+  }
+  local.assign((sockaddr *)&address, length);
+  return true;
+}
+
+bool Socket::JoinGroup(const Endpoint &group, const Endpoint &local) {
+  if (group.family() == AF_INET) {
+    struct ip_mreqn request;
+    ::memset(&request, 0, sizeof(request));
+    request.imr_multiaddr = ((const sockaddr_in *)group.address())->sin_addr;
+    if (local.family() == AF_INET) {
+      request.imr_address = ((const sockaddr_in *)local.address())->sin_addr;
+    }
+    return ::setsockopt(_sock_desc, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request,
+                        sizeof(request)) == 0;
+  }
+  struct ipv6_mreq request;
+  ::memset(&request, 0, sizeof(request));
+  request.ipv6mr_multiaddr = ((const sockaddr_in6 *)group.address())->sin6_addr;
+  if (local.family() == AF_INET6) {
+    request.ipv6mr_interface =
+        ((const sockaddr_in6 *)local.address())->sin6_scope_id;
+  }
+  return ::setsockopt(_sock_desc, IPPROTO_IPV6, IPV6_JOIN_GROUP, &request,
+                      sizeof(request)) == 0;
+}
+
+bool Socket::SetBackend(Backend backend) {
+  if (backend == SyscallBackend) {
+    m_ring.reset();
+    return true;
+  }
+  if (m_ring) return true;
+  std::unique_ptr<IoUring> ring(new IoUring());
+  if (!ring->init(m_ringEntries)) return false;
+  m_ring = std::move(ring);
+  return true;
+}
+
+int Socket::WaitForRead(int timeoutMs) {
+  struct pollfd pfd;
+  pfd.fd = _sock_desc;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ready;
+  do {
+    ready = ::poll(&pfd, 1, timeoutMs);
+  } while (ready == -1 && errno == EINTR);
+  return ready;
+}
+
+bool Socket::SetNonBlocking(bool enable) {
+  const int flags = ::fcntl(_sock_desc, F_GETFL, 0);
+  if (flags == -1) return false;
+  const int wanted = enable ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+  return ::fcntl(_sock_desc, F_SETFL, wanted) == 0;
+}
+
 int Socket::GetDescriptor() {
   return _sock_desc;
 }
 
-sockaddr_in Socket::GetDestinationAddress() {
-  return remoteAddrInfo;
+bool Socket::Bind(const Endpoint &local, bool reusePort) {
+  int enable = 1;
+  if (reusePort && ::setsockopt(_sock_desc, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+    return false;
+  }
+  return ::bind(_sock_desc, local.address(), local.length()) == 0;
 }
 
-UDPClient::UDPClient(std::string ip, int port) {
-  _sock_desc = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-  bool socket_fail = _sock_desc == -1;
-
-  remoteAddrInfo.sin_family = AF_INET;
-  remoteAddrInfo.sin_port = htons(port);
-  remoteAddrInfo.sin_addr.s_addr = inet_addr(ip.c_str());
+UDPSocket::UDPSocket(int family) {
+  m_family = family;
+  _sock_desc = socket(m_family, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+  SetNonBlocking(true);
+}
 
-  struct timeval timeout;
-  timeout.tv_sec = 2;
-  timeout.tv_usec = 0;
-  ::setsockopt(_sock_desc, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
-  timeout.tv_sec = 2;
-  ::setsockopt(_sock_desc, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout));
+UDPClient::UDPClient(const Endpoint &peer) : UDPSocket(peer.family()) {
+  m_endpoint = peer;
 }
 
-UDPClient::~UDPClient() { close(_sock_desc); }
\ No newline at end of file
+UDPClient::UDPClient(std::string ip, int port) {
+  // The socket takes the family of the server; an unresolvable host leaves
+  // an IPv4 socket and the transfer reports the failure.
+  if (m_endpoint.resolve(ip, port)) m_family = m_endpoint.family();
+  _sock_desc = socket(m_family, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+
+  SetNonBlocking(true);
+}
\ No newline at end of file